@@ -0,0 +1,206 @@
+#include "BackgroundModel.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//OpenCV's MOG2 keeps, for each of its 5 Gaussians, a weight, a mean and a variance as floats, plus a byte
+//with the number of Gaussians in use
+const size_t MOG2_BYTES_PER_PIXEL = 5 * 3 * sizeof(float) + 1;
+
+namespace {
+
+#if defined(__AVX2__)
+
+typedef __m256i Vec;
+const int VEC_U16 = 16;
+
+inline Vec widenU8(const uint8_t *p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)); }
+inline Vec loadU16(const uint16_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+inline void storeU16(uint16_t *p, Vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+inline Vec splat16(int v) { return _mm256_set1_epi16((short)v); }
+inline Vec shl7(Vec v) { return _mm256_slli_epi16(v, 7); }
+inline Vec add16(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+inline Vec sub16(Vec a, Vec b) { return _mm256_sub_epi16(a, b); }
+inline Vec abs16(Vec v) { return _mm256_abs_epi16(v); }
+inline Vec greater16(Vec a, Vec b) { return _mm256_cmpgt_epi16(a, b); }
+inline Vec mulHigh16(Vec a, Vec b) { return _mm256_mulhi_epi16(a, b); }
+inline Vec mulLow16(Vec a, Vec b) { return _mm256_mullo_epi16(a, b); }
+inline Vec shr15(Vec v) { return _mm256_srli_epi16(v, 15); }
+inline Vec select(Vec mask, Vec a, Vec b) { return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b)); }
+inline void storeNarrowMask(uint8_t *p, Vec v) {
+    _mm_storeu_si128((__m128i *)p, _mm_packs_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+#define VC_BACKGROUND_SIMD
+
+#elif defined(__SSE2__)
+
+typedef __m128i Vec;
+const int VEC_U16 = 8;
+
+inline Vec widenU8(const uint8_t *p) { return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()); }
+inline Vec loadU16(const uint16_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+inline void storeU16(uint16_t *p, Vec v) { _mm_storeu_si128((__m128i *)p, v); }
+inline Vec splat16(int v) { return _mm_set1_epi16((short)v); }
+inline Vec shl7(Vec v) { return _mm_slli_epi16(v, 7); }
+inline Vec add16(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+inline Vec sub16(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
+inline Vec abs16(Vec v) { return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v)); }
+inline Vec greater16(Vec a, Vec b) { return _mm_cmpgt_epi16(a, b); }
+inline Vec mulHigh16(Vec a, Vec b) { return _mm_mulhi_epi16(a, b); }
+inline Vec mulLow16(Vec a, Vec b) { return _mm_mullo_epi16(a, b); }
+inline Vec shr15(Vec v) { return _mm_srli_epi16(v, 15); }
+inline Vec select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+inline void storeNarrowMask(uint8_t *p, Vec v) { _mm_storel_epi64((__m128i *)p, _mm_packs_epi16(v, v)); }
+#define VC_BACKGROUND_SIMD
+
+#endif
+
+}
+
+
+BackgroundDetector::BackgroundDetector(const TrackingParams &params, size_t bytesPerPixel)
+        : params(params), bytesPerPixel(bytesPerPixel), region(params) {
+    structuringElement5x5 = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+}
+
+
+//Same aspect ratio, area scaled down to what the budget allows
+cv::Size BackgroundDetector::fitToBudget(const cv::Size &size) const {
+    double bytes = (double)size.area() * bytesPerPixel;
+    if (bytes <= (double)params.backgroundMemoryBudget) {
+        return size;
+    }
+    double factor = std::sqrt((double)params.backgroundMemoryBudget / bytes);
+    return cv::Size(std::max(1, (int)(size.width * factor)), std::max(1, (int)(size.height * factor)));
+}
+
+
+bool BackgroundDetector::apply(const cv::Mat &sourceFrame) {
+    VC_TIME_STAGE(Preprocess);
+    const cv::Mat &frame = region.apply(sourceFrame);
+    if (params.fusedPreprocessing && frame.type() == CV_8UC3 && frame.rows >= 5 && frame.cols >= 5) {
+        imgBlurred.create(frame.rows, frame.cols, CV_8UC1);
+        fused.process(frame.ptr(), frame.step, frame.cols, frame.rows, imgBlurred.ptr(), imgBlurred.step,
+                      nullptr, nullptr, 0, params.diffThreshold);
+    } else {
+        cv::GaussianBlur(grayscale(frame, imgGray), imgBlurred, cv::Size(5, 5), 0);
+    }
+
+    cv::Size size = fitToBudget(imgBlurred.size());
+    bool scaled = size != imgBlurred.size();
+    if (scaled) {
+        cv::resize(imgBlurred, imgModelInput, size, 0, 0, cv::INTER_AREA);
+    }
+    const cv::Mat &input = scaled ? imgModelInput : imgBlurred;
+    if (!primed) {
+        modelImageSize = size;
+        initialize(input);
+        primed = true;
+        return false;
+    }
+    if (size != modelImageSize) {
+        //The processed image changed size: start over, without motion for this frame
+        modelImageSize = size;
+        initialize(input);
+        imgThreshold.create(imgBlurred.size(), CV_8UC1);
+        imgThreshold.setTo(cv::Scalar::all(0));
+        return true;
+    }
+
+    if (scaled) {
+        update(input, imgForeground);
+        cv::resize(imgForeground, imgThreshold, imgBlurred.size(), 0, 0, cv::INTER_NEAREST);
+    } else {
+        update(input, imgThreshold);
+    }
+    for (unsigned int i = 0; i < 2; i++) {
+        cv::dilate(imgThreshold, imgMorphology, structuringElement5x5, cv::Point(-1, -1), 2);
+        cv::erode(imgMorphology, imgThreshold, structuringElement5x5);
+    }
+    region.maskOutside(imgThreshold);
+    return true;
+}
+
+
+RunningAverageDetector::RunningAverageDetector(const TrackingParams &params)
+        : BackgroundDetector(params, sizeof(uint16_t)) {
+    threshold = (int)std::lround(std::min(std::max(params.diffThreshold, 0.0), 255.0) * 128.0);
+    rate = (int)std::lround(std::min(std::max(params.backgroundRate, 0.0), 0.5) * 65536.0);
+    rate = std::min(std::max(rate, 1), 32767);
+    foregroundRate = std::max(rate / 8, 1);
+}
+
+
+//The difference fits 16 bits because the background is kept in 9.7 fixed point (at most 255 << 7), and
+//moving by about half of it at most keeps the background in that range. The step is d * rate / 65536 rounded to
+//nearest: the high half of the 32-bit product plus the top bit of its low half, which is what adding 32768
+//before >> does in the scalar tail. Truncating instead would leave the background up to 65536 / rate below
+//a brighter road for good.
+void RunningAverageDetector::updateRow(const uint8_t *gray, uint16_t *background, uint8_t *foreground, int width,
+                                       int threshold, int rate, int foregroundRate) {
+    int x = 0;
+#ifdef VC_BACKGROUND_SIMD
+    const Vec thresholdVec = splat16(threshold);
+    const Vec rateVec = splat16(rate);
+    const Vec foregroundRateVec = splat16(foregroundRate);
+    for (; x + VEC_U16 <= width; x += VEC_U16) {
+        Vec current = loadU16(background + x);
+        Vec difference = sub16(shl7(widenU8(gray + x)), current);
+        Vec moving = greater16(abs16(difference), thresholdVec);
+        Vec pixelRate = select(moving, foregroundRateVec, rateVec);
+        Vec step = add16(mulHigh16(difference, pixelRate), shr15(mulLow16(difference, pixelRate)));
+        storeU16(background + x, add16(current, step));
+        storeNarrowMask(foreground + x, moving);
+    }
+#endif
+    for (; x < width; x++) {
+        int difference = (gray[x] << 7) - background[x];
+        bool moving = std::abs(difference) > threshold;
+        background[x] = (uint16_t)(background[x] + ((difference * (moving ? foregroundRate : rate) + 32768) >> 16));
+        foreground[x] = moving ? 255 : 0;
+    }
+}
+
+
+void RunningAverageDetector::initialize(const cv::Mat &gray) {
+    background.resize((size_t)gray.rows * gray.cols);
+    for (int y = 0; y < gray.rows; y++) {
+        const uint8_t *row = gray.ptr<uint8_t>(y);
+        uint16_t *model = background.data() + (size_t)y * gray.cols;
+        for (int x = 0; x < gray.cols; x++) {
+            model[x] = (uint16_t)(row[x] << 7);
+        }
+    }
+}
+
+
+void RunningAverageDetector::update(const cv::Mat &gray, cv::Mat &foreground) {
+    foreground.create(gray.rows, gray.cols, CV_8UC1);
+    for (int y = 0; y < gray.rows; y++) {
+        updateRow(gray.ptr<uint8_t>(y), background.data() + (size_t)y * gray.cols, foreground.ptr<uint8_t>(y),
+                  gray.cols, threshold, rate, foregroundRate);
+    }
+}
+
+
+Mog2Detector::Mog2Detector(const TrackingParams &params) : BackgroundDetector(params, MOG2_BYTES_PER_PIXEL) {
+}
+
+
+//A learning rate of 1 makes the first frame the whole model
+void Mog2Detector::initialize(const cv::Mat &gray) {
+    int history = (int)std::lround(1.0 / std::max(params.backgroundRate, 1e-6));
+    model = cv::createBackgroundSubtractorMOG2(std::max(history, 1), 16.0, false);
+    model->apply(gray, imgInitial, 1.0);
+}
+
+
+void Mog2Detector::update(const cv::Mat &gray, cv::Mat &foreground) {
+    model->apply(gray, foreground);
+}
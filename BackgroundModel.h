@@ -0,0 +1,102 @@
+#ifndef BACKGROUND_MODEL_H
+#define BACKGROUND_MODEL_H
+
+#include "MotionDetector.h"
+#include "FusedPreprocess.h"
+#include "ProcessingRegion.h"
+#include <cstdint>
+#include <vector>
+#include <opencv2/video/background_segm.hpp>
+
+// Detectors that compare each frame with a model of the empty road instead of the previous frame. The model
+// learns a little from every frame (params.backgroundRate), so a slow or stopped vehicle stays a solid blob
+// until it has been standing for a while, where frame differencing only sees its moving edges.
+// Frames are reduced to the ProcessingRegion, converted to grayscale and blurred as in FrameDiffer (with
+// FusedPreprocessor when params.fusedPreprocessing is set), and the foreground gets FrameDiffer's dilate/erode
+// passes, so extractBlobs and its thresholds apply unchanged. If the model of a processed image would take more
+// than params.backgroundMemoryBudget bytes, it is kept at a lower resolution and its foreground resized back.
+// No image buffers are allocated once the frame size is known.
+class BackgroundDetector : public MotionDetector {
+public:
+    // The first frame only starts the model
+    bool apply(const cv::Mat &frame) override;
+
+    cv::Mat &mask() override { return imgThreshold; }
+
+    void reset() override { primed = false; }
+
+    // Resolution and size of the model for the current frame size
+    cv::Size modelSize() const { return modelImageSize; }
+    size_t modelBytes() const { return (size_t)modelImageSize.area() * bytesPerPixel; }
+
+protected:
+    BackgroundDetector(const TrackingParams &params, size_t bytesPerPixel);
+
+    // Starts the model from one blurred grayscale image of the model size
+    virtual void initialize(const cv::Mat &gray) = 0;
+    // Writes the foreground of gray (0 or 255, CV_8UC1, the size of gray) and updates the model with gray
+    virtual void update(const cv::Mat &gray, cv::Mat &foreground) = 0;
+
+    TrackingParams params;
+
+private:
+    cv::Size fitToBudget(const cv::Size &size) const;
+
+    size_t bytesPerPixel;
+    ProcessingRegion region;
+    FusedPreprocessor fused;
+    cv::Mat structuringElement5x5;
+    cv::Mat imgGray;
+    cv::Mat imgBlurred;
+    cv::Mat imgModelInput;
+    cv::Mat imgForeground;
+    cv::Mat imgThreshold;
+    cv::Mat imgMorphology;
+    cv::Size modelImageSize;
+    bool primed = false;
+};
+
+// Exponential running average of the grayscale, kept per pixel in 16-bit fixed point (2 bytes per pixel).
+// A pixel is foreground when it differs from the average by more than params.diffThreshold. Foreground pixels
+// are learned at 1/8 of the rate, so a vehicle that stops takes eight times longer to disappear than the road
+// takes to adapt to a change of light.
+class RunningAverageDetector : public BackgroundDetector {
+public:
+    explicit RunningAverageDetector(const TrackingParams &params = TrackingParams());
+
+    // One row: foreground[x] = 255 where |gray[x] - background[x]| > threshold, 0 elsewhere, then
+    // background[x] += difference * rate / 65536, rounded (foregroundRate on foreground pixels, rates < 32768).
+    // background and threshold are gray levels in 9.7 fixed point. Vectorized with SSE2 or AVX2 like
+    // FusedPreprocessor; the result is the same on every instruction set.
+    static void updateRow(const uint8_t *gray, uint16_t *background, uint8_t *foreground, int width,
+                          int threshold, int rate, int foregroundRate);
+
+protected:
+    void initialize(const cv::Mat &gray) override;
+    void update(const cv::Mat &gray, cv::Mat &foreground) override;
+
+private:
+    std::vector<uint16_t> background;
+    int threshold;
+    int rate;
+    int foregroundRate;
+};
+
+// OpenCV's BackgroundSubtractorMOG2 (a mixture of up to five Gaussians per pixel) on the grayscale, with
+// shadow detection off. Adapts to flicker and waving trees the running average would report as motion, at
+// about 60 bytes per pixel and several times its cost. The history is 1 / params.backgroundRate frames;
+// params.diffThreshold is not used, MOG2 thresholds on the variance it learns per pixel.
+class Mog2Detector : public BackgroundDetector {
+public:
+    explicit Mog2Detector(const TrackingParams &params = TrackingParams());
+
+protected:
+    void initialize(const cv::Mat &gray) override;
+    void update(const cv::Mat &gray, cv::Mat &foreground) override;
+
+private:
+    cv::Ptr<cv::BackgroundSubtractorMOG2> model;
+    cv::Mat imgInitial;
+};
+
+#endif    // BACKGROUND_MODEL_H
@@ -0,0 +1,559 @@
+#include "BatchMode.h"
+#include "BlobGrid.h"
+#include "VideoLog.h"
+#include "VideoJobPool.h"
+#include "FrameDiffer.h"
+#include "BinaryLog.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <sstream>
+#include <glob.h>
+#include <sys/stat.h>
+
+
+void printBatchUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options] <video|glob>..." << std::endl
+              << "Logs every video without prompting. Run without arguments for the interactive menu." << std::endl
+              << std::endl
+              << "  -f, --format <formats>       comma-separated log formats, all written in one pass:" << std::endl
+              << "                               txt, vclog, csv, jsonl, database or null (default txt)" << std::endl
+              << "  -o, --output-dir <dir>       directory for file logs (default " << DEFAULT_LOG_DIR << ")" << std::endl
+              << "  --db <conninfo>              PostgreSQL connection string for the database format" << std::endl
+              << "  --db-batch <n>               frames per COPY/INSERT batch (default 100)" << std::endl
+              << "  --db-insert                  send batches as multi-row INSERTs instead of COPY" << std::endl
+              << "  -j, --jobs <n>               videos logged in parallel (default 1)" << std::endl
+              << "  --pipeline                   decode, preprocess and extract blobs on separate threads" << std::endl
+              << "  --queue-size <n>             frames buffered between pipeline stages (default 8)" << std::endl
+              << "  --fused                      use the fused SIMD preprocessing kernel" << std::endl
+              << "  --detector <diff|average|mog2>" << std::endl
+              << "                               motion detection: consecutive frame difference (default)," << std::endl
+              << "                               running average background or MOG2 background model" << std::endl
+              << "  --background-rate <x>        share of each frame learned by the background (default 0.005)" << std::endl
+              << "  --background-memory <MB>     largest background model; bigger ones get a lower resolution" << std::endl
+              << "                               (default 64)" << std::endl
+              << "  --motion-gate <n>            skip detection in frames without motion at 1/n size (diff only)" << std::endl
+              << "  --stride <n>                 track every n-th frame, extrapolate the tracks in between" << std::endl
+              << "  --decoder <opencv|luma>      decode with VideoCapture to BGR (default), or only the luma with" << std::endl
+              << "                               FFmpeg if built with it (VideoCapture where not possible)" << std::endl
+              << "  --decoder-threads <n>        FFmpeg decoding threads per video, 0 for one per core (default)" << std::endl
+              << "  --segments <n>               track n time segments of every video at once and join their" << std::endl
+              << "                               tracks (the video must seek frame-accurately)" << std::endl
+              << "  --segment-overlap <n>        frames tracked before each segment to join its tracks (default 50)" << std::endl
+              << "  --segment-check              also track serially and report where the segments differ" << std::endl
+              << "  --stream                     live source (RTSP, v4l2, pipe): read until EOF or SIGINT/SIGTERM" << std::endl
+              << "  --drop <policy>              when tracking falls behind: block, oldest (default) or latest" << std::endl
+              << "  --stream-buffer <n>          frames buffered between capture and tracking (default 8)" << std::endl
+              << "  --latency-budget <ms>        skip frames older than this if newer ones wait (default 500)" << std::endl
+              << "  --realtime                   stream a file at its frame rate, like a camera (implies --stream)" << std::endl
+              << "  --stream-report <s>          seconds between lag reports, 0 for none (default 10)" << std::endl
+              << "  --checkpoint <s>             save the progress of every video each s seconds; DB rows are" << std::endl
+              << "                               committed at each checkpoint (--detector diff only)" << std::endl
+              << "  --resume                     continue videos from their checkpoints (checkpoints every 30 s" << std::endl
+              << "                               unless --checkpoint is given)" << std::endl
+              << "  --metrics <path>             write stage timings and counters to path: Prometheus text, or JSON" << std::endl
+              << "                               if it ends in .json" << std::endl
+              << "  --metrics-interval <s>       seconds between metrics writes (default 10)" << std::endl
+              << "  --convert-logs               treat inputs as TXT logs and convert them to vclog" << std::endl
+              << "  --expect <log>               compare the TXT log of a single video with a reference log" << std::endl
+              << "  --validate-fused             compare fused and OpenCV masks on every frame instead of logging" << std::endl
+              << "  --match <nearest|greedy>     track matching: per detection (default) or global greedy" << std::endl
+              << "  --grid-cell <n>              cell size of the track index in pixels (default 256, min 16)" << std::endl
+              << "  --max-idle <n>               retire tracks not matched for n frames (default 0: never)" << std::endl
+              << "  --roi <x,y,x,y,x,y...>       only detect inside this polygon (source pixels)" << std::endl
+              << "  --scale <x>                  detect on frames resized by 0 < x <= 1 (default 1)" << std::endl
+              << "  --count-line <name:x1,y1,x2,y2[:lanes]>" << std::endl
+              << "                               count tracks crossing this line, per lane and direction" << std::endl
+              << "                               (repeatable); totals go to <output-dir>/<video>" << COUNTS_EXT << std::endl
+              << "  --count-bucket <s>           seconds per aggregated count row (default 1)" << std::endl
+              << "  --diff-threshold <n>         frame difference threshold (default 30)" << std::endl
+              << "  --min-area <n>               minimal bounding rect area (default 32000)" << std::endl
+              << "  --min-width <n>              minimal bounding rect width (default 128)" << std::endl
+              << "  --min-height <n>             minimal bounding rect height (default 128)" << std::endl
+              << "  --min-diagonal <n>           minimal bounding rect diagonal (default 256)" << std::endl
+              << "  --min-aspect <x>             minimal width/height ratio (default 1.2)" << std::endl
+              << "  --max-aspect <x>             maximal width/height ratio (default 4.0)" << std::endl
+              << "  --min-fill <x>               minimal hull area / bounding rect area (default 0.5)" << std::endl
+              << "  -h, --help                   show this message" << std::endl;
+}
+
+
+//"x1,y1,x2,y2,x3,y3..." -> polygon
+bool parseRoi(const std::string &value, std::vector<cv::Point> &roi) {
+    std::vector<int> coordinates;
+    std::istringstream ss(value);
+    std::string number;
+    while (std::getline(ss, number, ',')) {
+        coordinates.push_back(std::stoi(number));
+    }
+    if (coordinates.size() < 6 || coordinates.size() % 2 != 0) {
+        return false;
+    }
+    roi.clear();
+    for (size_t i = 0; i < coordinates.size(); i += 2) {
+        roi.emplace_back(coordinates[i], coordinates[i + 1]);
+    }
+    return true;
+}
+
+
+//"north:0,540,1920,540:3" -> line "north" from (0,540) to (1920,540), three lanes
+bool parseCountLine(const std::string &value, CountLine &line) {
+    std::istringstream ss(value);
+    std::string coordinates, lanes;
+    if (!std::getline(ss, line.name, ':') || line.name.empty() || !std::getline(ss, coordinates, ':')) {
+        return false;
+    }
+    int x1, y1, x2, y2;
+    char c1, c2, c3;
+    std::istringstream points(coordinates);
+    if (!(points >> x1 >> c1 >> y1 >> c2 >> x2 >> c3 >> y2) || c1 != ',' || c2 != ',' || c3 != ',') {
+        return false;
+    }
+    line.a = cv::Point(x1, y1);
+    line.b = cv::Point(x2, y2);
+    line.lanes = std::getline(ss, lanes) ? std::stoi(lanes) : 1;
+    return line.lanes >= 1 && line.a != line.b;
+}
+
+
+bool parseBatchOptions(int argc, char **argv, BatchOptions &options, std::string &error) {
+    options.outputDir = DEFAULT_LOG_DIR;
+    options.dbConnection = DB_CONNECTION;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.empty() || arg[0] != '-') {
+            options.inputs.push_back(arg);
+            continue;
+        }
+        if (arg == "--pipeline") {
+            options.params.pipelined = true;
+            continue;
+        }
+        if (arg == "--fused") {
+            options.params.fusedPreprocessing = true;
+            continue;
+        }
+        if (arg == "--validate-fused") {
+            options.validateFused = true;
+            continue;
+        }
+        if (arg == "--db-insert") {
+            options.db.useCopy = false;
+            continue;
+        }
+        if (arg == "--convert-logs") {
+            options.convertLogs = true;
+            continue;
+        }
+        if (arg == "--stream") {
+            options.stream.enabled = true;
+            continue;
+        }
+        if (arg == "--segment-check") {
+            options.segments.compareSerial = true;
+            continue;
+        }
+        if (arg == "--resume") {
+            options.resume = true;
+            continue;
+        }
+        if (arg == "--realtime") {
+            options.stream.enabled = true;
+            options.stream.realtime = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "Missing value for " + arg;
+            return false;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "-f" || arg == "--format") {
+                options.logTypeCodes.clear();
+                options.nullSink = false;
+                std::istringstream formats(value);
+                std::string format;
+                while (std::getline(formats, format, ',')) {
+                    if (format == "null") {
+                        options.nullSink = true;
+                        continue;
+                    }
+                    int code = 0;
+                    for (int j = 1; j <= TYPES_NUMBER; j++) {
+                        if (format == logTypes[j] || "." + format == logTypes[j]) {
+                            code = j;
+                        }
+                    }
+                    if (code == 0) {
+                        error = "Unknown log format " + format;
+                        return false;
+                    }
+                    if (std::find(options.logTypeCodes.begin(), options.logTypeCodes.end(), code) ==
+                        options.logTypeCodes.end()) {
+                        options.logTypeCodes.push_back(code);
+                    }
+                }
+                if (options.logTypeCodes.empty() && !options.nullSink) {
+                    error = "No log format given";
+                    return false;
+                }
+            } else if (arg == "-o" || arg == "--output-dir") {
+                options.outputDir = value;
+            } else if (arg == "--db") {
+                options.dbConnection = value;
+            } else if (arg == "--db-batch") {
+                options.db.batchFrames = std::stoi(value);
+                if (options.db.batchFrames < 1) {
+                    error = "--db-batch must be at least 1";
+                    return false;
+                }
+            } else if (arg == "--expect") {
+                options.expectedLog = value;
+            } else if (arg == "-j" || arg == "--jobs") {
+                options.jobs = std::stoi(value);
+                if (options.jobs < 1) {
+                    error = "--jobs must be at least 1";
+                    return false;
+                }
+            } else if (arg == "--queue-size") {
+                options.params.pipelineQueueSize = std::stoi(value);
+            } else if (arg == "--match") {
+                if (value == "nearest") {
+                    options.params.matchMode = MatchMode::Nearest;
+                } else if (value == "greedy") {
+                    options.params.matchMode = MatchMode::Greedy;
+                } else {
+                    error = "Unknown match mode " + value;
+                    return false;
+                }
+            } else if (arg == "--detector") {
+                if (!parseDetectorMode(value, options.params.detector)) {
+                    error = "Unknown detector " + value;
+                    return false;
+                }
+            } else if (arg == "--background-rate") {
+                options.params.backgroundRate = std::stod(value);
+                if (!(options.params.backgroundRate > 0.0 && options.params.backgroundRate <= 0.5)) {
+                    error = "--background-rate must be in (0, 0.5]";
+                    return false;
+                }
+            } else if (arg == "--background-memory") {
+                double megabytes = std::stod(value);
+                if (!(megabytes > 0.0)) {
+                    error = "--background-memory must be positive";
+                    return false;
+                }
+                options.params.backgroundMemoryBudget = (size_t)(megabytes * (1 << 20));
+            } else if (arg == "--motion-gate") {
+                options.params.motionGateScale = std::stoi(value);
+                if (options.params.motionGateScale < 2) {
+                    error = "--motion-gate must be at least 2";
+                    return false;
+                }
+            } else if (arg == "--stride") {
+                options.params.frameStride = std::stoi(value);
+                if (options.params.frameStride < 1) {
+                    error = "--stride must be positive";
+                    return false;
+                }
+            } else if (arg == "--decoder") {
+                if (value == "opencv") {
+                    options.decoder.luma = false;
+                } else if (value == "luma") {
+                    options.decoder.luma = true;
+                } else {
+                    error = "Unknown decoder " + value;
+                    return false;
+                }
+            } else if (arg == "--decoder-threads") {
+                options.decoder.threads = std::stoi(value);
+                if (options.decoder.threads < 0) {
+                    error = "--decoder-threads must not be negative";
+                    return false;
+                }
+            } else if (arg == "--segments") {
+                options.segments.segments = std::stoi(value);
+                if (options.segments.segments < 1) {
+                    error = "--segments must be positive";
+                    return false;
+                }
+            } else if (arg == "--segment-overlap") {
+                options.segments.overlapFrames = std::stoi(value);
+                if (options.segments.overlapFrames < 1) {
+                    error = "--segment-overlap must be positive";
+                    return false;
+                }
+            } else if (arg == "--grid-cell") {
+                options.params.gridCellSize = std::stoi(value);
+                if (options.params.gridCellSize < MIN_GRID_CELL_SIZE) {
+                    error = "--grid-cell must be at least " + std::to_string(MIN_GRID_CELL_SIZE);
+                    return false;
+                }
+            } else if (arg == "--max-idle") {
+                options.params.maxIdleFrames = std::stoi(value);
+            } else if (arg == "--roi") {
+                if (!parseRoi(value, options.params.roi)) {
+                    error = "--roi needs at least three x,y points";
+                    return false;
+                }
+            } else if (arg == "--scale") {
+                options.params.processingScale = std::stod(value);
+                if (!(options.params.processingScale > 0.0 && options.params.processingScale <= 1.0)) {
+                    error = "--scale must be in (0, 1]";
+                    return false;
+                }
+            } else if (arg == "--drop") {
+                if (value == "block") {
+                    options.stream.dropPolicy = DropPolicy::Block;
+                } else if (value == "oldest") {
+                    options.stream.dropPolicy = DropPolicy::DropOldest;
+                } else if (value == "latest") {
+                    options.stream.dropPolicy = DropPolicy::Latest;
+                } else {
+                    error = "Unknown drop policy " + value;
+                    return false;
+                }
+            } else if (arg == "--stream-buffer") {
+                options.stream.bufferFrames = std::stoi(value);
+                if (options.stream.bufferFrames < 1) {
+                    error = "--stream-buffer must be at least 1";
+                    return false;
+                }
+            } else if (arg == "--latency-budget") {
+                options.stream.latencyBudgetMs = std::stod(value);
+            } else if (arg == "--stream-report") {
+                options.stream.reportSeconds = std::stod(value);
+            } else if (arg == "--checkpoint") {
+                options.checkpointSeconds = std::stod(value);
+                if (!(options.checkpointSeconds > 0)) {
+                    error = "--checkpoint must be positive";
+                    return false;
+                }
+            } else if (arg == "--metrics") {
+                if (!VC_METRICS) {
+                    error = "Built without metrics (VC_METRICS=OFF)";
+                    return false;
+                }
+                options.metricsPath = value;
+            } else if (arg == "--metrics-interval") {
+                options.metricsIntervalSeconds = std::stod(value);
+                if (!(options.metricsIntervalSeconds > 0)) {
+                    error = "--metrics-interval must be positive";
+                    return false;
+                }
+            } else if (arg == "--count-line") {
+                CountLine line;
+                if (!parseCountLine(value, line)) {
+                    error = "--count-line needs name:x1,y1,x2,y2 or name:x1,y1,x2,y2:lanes";
+                    return false;
+                }
+                if ((int)options.params.countLines.size() >= MAX_COUNT_LINES) {
+                    error = "At most " + std::to_string(MAX_COUNT_LINES) + " count lines";
+                    return false;
+                }
+                options.params.countLines.push_back(line);
+            } else if (arg == "--count-bucket") {
+                options.countBucketSeconds = std::stod(value);
+                if (!(options.countBucketSeconds > 0)) {
+                    error = "--count-bucket must be positive";
+                    return false;
+                }
+            } else if (arg == "--diff-threshold") {
+                options.params.diffThreshold = std::stod(value);
+            } else if (arg == "--min-area") {
+                options.params.minBlobArea = std::stoi(value);
+            } else if (arg == "--min-width") {
+                options.params.minBlobWidth = std::stoi(value);
+            } else if (arg == "--min-height") {
+                options.params.minBlobHeight = std::stoi(value);
+            } else if (arg == "--min-diagonal") {
+                options.params.minBlobDiagonal = std::stod(value);
+            } else if (arg == "--min-aspect") {
+                options.params.minAspectRatio = std::stod(value);
+            } else if (arg == "--max-aspect") {
+                options.params.maxAspectRatio = std::stod(value);
+            } else if (arg == "--min-fill") {
+                options.params.minFillRatio = std::stod(value);
+            } else {
+                error = "Unknown option " + arg;
+                return false;
+            }
+        } catch (const std::logic_error &e) {
+            error = "Invalid value for " + arg + ": " + value;
+            return false;
+        }
+    }
+    if (options.resume && options.checkpointSeconds == 0.0) {
+        options.checkpointSeconds = 30.0;
+    }
+    if (options.params.motionGateScale > 0 && options.params.detector != DetectorMode::FrameDiff) {
+        error = "--motion-gate works with --detector diff only";
+        return false;
+    }
+    //A background model is built from every frame so far and is not saved in checkpoints
+    if (options.params.detector != DetectorMode::FrameDiff && options.checkpointSeconds > 0) {
+        error = "--checkpoint and --resume work with --detector diff only";
+        return false;
+    }
+    if (options.params.frameStride > 1 && options.stream.enabled) {
+        error = "--stride needs video files; streams drop frames with --drop and --latency-budget";
+        return false;
+    }
+    if (options.decoder.luma && options.stream.enabled) {
+        error = "--decoder luma needs video files";
+        return false;
+    }
+    if (options.segments.segments > 1 && (options.stream.enabled || options.checkpointSeconds > 0)) {
+        error = "--segments needs video files and cannot be combined with --checkpoint or --resume";
+        return false;
+    }
+    if (options.segments.compareSerial && options.segments.segments < 2) {
+        error = "--segment-check needs --segments";
+        return false;
+    }
+    if (options.checkpointSeconds > 0 && options.stream.enabled) {
+        error = "Streams cannot be resumed, --checkpoint and --resume need video files";
+        return false;
+    }
+    if (!options.expectedLog.empty() &&
+        std::find(options.logTypeCodes.begin(), options.logTypeCodes.end(), 1) == options.logTypeCodes.end()) {
+        error = "--expect needs the txt format";
+        return false;
+    }
+    return true;
+}
+
+
+//Shells expand globs themselves, but quoted patterns are expanded here so huge lists don't hit ARG_MAX.
+std::vector<std::string> expandInputs(const std::vector<std::string> &patterns, bool &allMatched) {
+    std::vector<std::string> paths;
+    allMatched = true;
+    for (const auto &pattern : patterns) {
+        if (pattern.find_first_of("*?[") == std::string::npos) {
+            paths.push_back(pattern);
+            continue;
+        }
+        glob_t matches;
+        if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                paths.emplace_back(matches.gl_pathv[i]);
+            }
+        } else {
+            std::cerr << "No videos match " << pattern << std::endl;
+            allMatched = false;
+        }
+        globfree(&matches);
+    }
+    return paths;
+}
+
+
+bool validateFused(const std::vector<std::string> &paths, const TrackingParams &params) {
+    bool identical = true;
+    cv::VideoCapture videoCapture;
+    for (const auto &path : paths) {
+        std::cout << path << ": ";
+        videoCapture.open(path);
+        if (!videoCapture.isOpened() || videoCapture.get(CV_CAP_PROP_FRAME_COUNT) < 2) {
+            std::cout << "cannot open the video" << std::endl;
+            identical = false;
+            continue;
+        }
+        try {
+            identical = validateFusedPreprocessing(videoCapture, params) == 0 && identical;
+        } catch (cv::Exception &e) {
+            std::cout << e.msg << std::endl;
+            identical = false;
+        }
+    }
+    return identical;
+}
+
+
+bool convertLogs(const std::vector<std::string> &paths, const std::string &outputDir) {
+    bool converted = true;
+    mkdir(outputDir.c_str(), S_IRWXU);
+    for (const auto &path : paths) {
+        std::string binaryPath = outputDir + "/" + logNameFromPath(path) + BIN_EXT;
+        if (convertTxtLogToBinary(path, binaryPath)) {
+            std::cout << path << " -> " << binaryPath << std::endl;
+        } else {
+            converted = false;
+        }
+    }
+    return converted;
+}
+
+
+int runBatch(int argc, char **argv) {
+    BatchOptions options;
+    std::string error;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printBatchUsage(argv[0]);
+            return 0;
+        }
+    }
+    if (!parseBatchOptions(argc, argv, options, error) || (options.inputs.empty() && error.empty())) {
+        std::cerr << (error.empty() ? "No input videos given" : error) << std::endl;
+        printBatchUsage(argv[0]);
+        return 2;
+    }
+
+    bool allMatched;
+    std::vector<std::string> paths = expandInputs(options.inputs, allMatched);
+
+    if (options.validateFused) {
+        return validateFused(paths, options.params) && allMatched ? 0 : 1;
+    }
+    if (options.convertLogs) {
+        return convertLogs(paths, options.outputDir) && allMatched ? 0 : 1;
+    }
+
+    std::string producedLog;
+    if (!options.expectedLog.empty()) {
+        struct stat expectedStat, producedStat;
+        if (paths.size() != 1) {
+            std::cerr << "--expect needs exactly one video" << std::endl;
+            return 2;
+        }
+        producedLog = options.outputDir + "/" + logNameFromPath(paths[0]) + TXT_EXT;
+        if (stat(options.expectedLog.c_str(), &expectedStat) == 0 && stat(producedLog.c_str(), &producedStat) == 0 &&
+            expectedStat.st_dev == producedStat.st_dev && expectedStat.st_ino == producedStat.st_ino) {
+            std::cerr << "The reference log would be overwritten, choose another --output-dir" << std::endl;
+            return 2;
+        }
+    }
+
+    if (options.stream.enabled) {
+        installStreamStopHandlers();
+    }
+
+    std::unique_ptr<MetricsExporter> metrics;
+    if (!options.metricsPath.empty()) {
+        metrics.reset(new MetricsExporter(options.metricsPath, options.metricsIntervalSeconds));
+    }
+    auto start = std::chrono::steady_clock::now();
+    VideoJobPool pool(options, options.jobs);
+    bool ok = pool.run(paths) && allMatched;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    //Final write with the complete totals
+    metrics.reset();
+
+    pool.printWorkerStats();
+    long frames = 0;
+    for (const auto &workerStats : pool.workerStats()) {
+        frames += workerStats.frames;
+    }
+    std::cout << "Wall clock " << seconds << " s (" << (seconds > 0 ? frames / seconds : 0.0)
+              << " frames/s over " << options.jobs << " workers)" << std::endl;
+
+    if (ok && !producedLog.empty()) {
+        ok = compareLogFiles(options.expectedLog, producedLog) == 0;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#ifndef BATCH_MODE_H
+#define BATCH_MODE_H
+
+#include "Tracking.h"
+#include "DbLog.h"
+#include "StreamIngest.h"
+#include "SegmentTracking.h"
+#include <string>
+#include <vector>
+
+// Everything the headless mode needs to log a set of videos without prompting.
+struct BatchOptions {
+    std::vector<std::string> inputs;
+    // Codes of logTypes (VideoLog.h) to write in the same pass; empty with nullSink for tracking only
+    std::vector<int> logTypeCodes{1};
+    bool nullSink = false;
+    std::string outputDir;
+    int jobs = 1;
+    bool validateFused = false;
+    // Inputs are TXT logs to convert to the binary format instead of videos
+    bool convertLogs = false;
+    // Reference TXT log the produced log must match (compatibility check for a single video)
+    std::string expectedLog;
+    TrackingParams params;
+    // Seconds per row group of the count line aggregates (params.countLines)
+    double countBucketSeconds = 1.0;
+    StreamOptions stream;
+    DecoderOptions decoder;
+    // Split every video into time segments tracked at once (segments.segments > 1)
+    SegmentOptions segments;
+    // Seconds between checkpoints of each video (<output-dir>/<video>.checkpoint), 0 for none
+    double checkpointSeconds = 0.0;
+    // Continue videos from their checkpoints
+    bool resume = false;
+    // Stage timings and counters (Metrics.h), rewritten every metricsIntervalSeconds; empty for none
+    std::string metricsPath;
+    double metricsIntervalSeconds = 10.0;
+    std::string dbConnection;
+    DbLogOptions db;
+};
+
+// Entry point for non-interactive runs: "VehicleCounter_V2 [options] <video|glob>...".
+// Returns the process exit code: 0 if every video was logged, 1 if any failed, 2 on bad usage.
+int runBatch(int argc, char **argv);
+
+// Inputs may be empty (runBatch requires some, the service does not)
+bool parseBatchOptions(int argc, char **argv, BatchOptions &options, std::string &error);
+bool parseRoi(const std::string &value, std::vector<cv::Point> &roi);
+bool parseCountLine(const std::string &value, CountLine &line);
+std::vector<std::string> expandInputs(const std::vector<std::string> &patterns, bool &allMatched);
+void printBatchUsage(const char *program);
+// Checks the fused preprocessing kernel against the OpenCV path on every frame of every video.
+bool validateFused(const std::vector<std::string> &paths, const TrackingParams &params);
+// Writes <outputDir>/<name>.vclog for every TXT log.
+bool convertLogs(const std::vector<std::string> &paths, const std::string &outputDir);
+
+#endif    // BATCH_MODE_H
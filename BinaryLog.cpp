@@ -0,0 +1,231 @@
+#include "BinaryLog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+bool BinaryLogWriter::open(const std::string &path) {
+    close();
+    this->path = path;
+    //A table left by an earlier run that was never resumed
+    std::remove((path + ".frames").c_str());
+    file.open(path, std::ios::binary | std::ios::trunc);
+    frameStart.assign(1, 0);
+    checkpointedFrames = 0;
+    recordCount = 0;
+    failed = !file.is_open();
+    if (!failed) {
+        //Placeholder, the real header is written by close()
+        BinaryLogHeader header = {};
+        file.write((const char *)&header, sizeof(header));
+    }
+    return !failed;
+}
+
+
+bool BinaryLogWriter::writeFrame(const BinaryLogRecord *records, size_t count) {
+    if (!file.is_open() || failed) {
+        return false;
+    }
+    file.write((const char *)records, count * sizeof(BinaryLogRecord));
+    recordCount += (uint32_t)count;
+    frameStart.push_back(recordCount);
+    return true;
+}
+
+
+bool BinaryLogWriter::close() {
+    if (!file.is_open()) {
+        return !failed;
+    }
+    BinaryLogHeader header = {};
+    std::memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+    header.version = BINARY_LOG_VERSION;
+    header.recordSize = sizeof(BinaryLogRecord);
+    header.frameCount = (uint32_t)(frameStart.size() - 1);
+    header.recordCount = recordCount;
+    header.frameTableOffset = sizeof(BinaryLogHeader) + (uint64_t)recordCount * sizeof(BinaryLogRecord);
+
+    file.write((const char *)frameStart.data(), frameStart.size() * sizeof(uint32_t));
+    file.seekp(0);
+    file.write((const char *)&header, sizeof(header));
+    file.close();
+    failed = failed || file.fail();
+    if (checkpointedFrames > 0) {
+        std::remove((path + ".frames").c_str());
+    }
+    return !failed;
+}
+
+
+void BinaryLogWriter::discard() {
+    if (!file.is_open()) {
+        return;
+    }
+    file.close();
+    failed = true;
+    std::remove(path.c_str());
+    std::remove((path + ".frames").c_str());
+}
+
+
+bool BinaryLogWriter::checkpoint(uint32_t &frames, uint32_t &records) {
+    file.flush();
+    std::ofstream table(path + ".frames", std::ios::binary | std::ios::app);
+    table.write((const char *)(frameStart.data() + checkpointedFrames),
+                (frameStart.size() - checkpointedFrames) * sizeof(uint32_t));
+    table.close();
+    if (failed || !file || table.fail()) {
+        return false;
+    }
+    checkpointedFrames = frameStart.size();
+    frames = (uint32_t)(frameStart.size() - 1);
+    records = recordCount;
+    return true;
+}
+
+
+bool BinaryLogWriter::resume(const std::string &path, uint32_t frames, uint32_t records) {
+    close();
+    this->path = path;
+    frameStart.assign(frames + 1, 0);
+    std::ifstream table(path + ".frames", std::ios::binary);
+    table.read((char *)frameStart.data(), frameStart.size() * sizeof(uint32_t));
+    uint64_t recordsEnd = sizeof(BinaryLogHeader) + (uint64_t)records * sizeof(BinaryLogRecord);
+    if (!table || frameStart[frames] != records || truncate(path.c_str(), (off_t)recordsEnd) != 0 ||
+        truncate((path + ".frames").c_str(), (off_t)(frameStart.size() * sizeof(uint32_t))) != 0) {
+        failed = true;
+        return false;
+    }
+    file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(0, std::ios::end);
+    checkpointedFrames = frameStart.size();
+    recordCount = records;
+    failed = !file.is_open();
+    return !failed;
+}
+
+
+bool BinaryLogReader::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(BinaryLogHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size = (size_t)fileStat.st_size;
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        return false;
+    }
+
+    header = (const BinaryLogHeader *)data;
+    uint64_t tableSize = ((uint64_t)header->frameCount + 1) * sizeof(uint32_t);
+    if (std::memcmp(header->magic, BINARY_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BINARY_LOG_VERSION || header->recordSize != sizeof(BinaryLogRecord) ||
+        header->frameTableOffset != sizeof(BinaryLogHeader) + (uint64_t)header->recordCount * sizeof(BinaryLogRecord) ||
+        header->frameTableOffset + tableSize > size) {
+        close();
+        return false;
+    }
+    records = (const BinaryLogRecord *)((const char *)data + sizeof(BinaryLogHeader));
+    frameStart = (const uint32_t *)((const char *)data + header->frameTableOffset);
+    //Checked once here, so begin() and end() of a corrupt log cannot point outside the records
+    uint32_t previous = 0;
+    for (uint32_t frame = 0; frame <= header->frameCount; frame++) {
+        if (frameStart[frame] < previous || frameStart[frame] > header->recordCount) {
+            close();
+            return false;
+        }
+        previous = frameStart[frame];
+    }
+    if (frameStart[header->frameCount] != header->recordCount) {
+        close();
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+
+void BinaryLogReader::close() {
+    if (data) {
+        munmap(data, size);
+    }
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    records = nullptr;
+    frameStart = nullptr;
+}
+
+
+bool convertTxtLogToBinary(const std::string &txtPath, const std::string &binaryPath) {
+    std::ifstream txt(txtPath);
+    if (!txt.is_open()) {
+        std::cerr << "Cannot open " << txtPath << std::endl;
+        return false;
+    }
+    BinaryLogWriter writer;
+    if (!writer.open(binaryPath)) {
+        std::cerr << "Cannot create " << binaryPath << std::endl;
+        return false;
+    }
+
+    std::vector<BinaryLogRecord> records;
+    std::string line;
+    long expectedFrame = 1;
+    while (std::getline(txt, line)) {
+        const char *p = line.c_str();
+        char *end;
+        long frame = std::strtol(p, &end, 10);
+        if (end == p || frame != expectedFrame) {
+            std::cerr << txtPath << ": bad frame number on line " << expectedFrame << std::endl;
+            writer.discard();
+            return false;
+        }
+        p = end;
+        records.clear();
+        while (true) {
+            long values[5];
+            int count = 0;
+            for (; count < 5; count++) {
+                values[count] = std::strtol(p, &end, 10);
+                if (end == p) {
+                    break;
+                }
+                p = end;
+            }
+            if (count == 0) {
+                break;
+            }
+            if (count < 5 || values[0] < 0 || !fitsBinaryLogRecord(values[1]) || !fitsBinaryLogRecord(values[2]) ||
+                !fitsBinaryLogRecord(values[3]) || !fitsBinaryLogRecord(values[4])) {
+                std::cerr << txtPath << ": bad record on line " << expectedFrame << std::endl;
+                writer.discard();
+                return false;
+            }
+            records.push_back({(uint32_t)values[0], (int16_t)values[1], (int16_t)values[2],
+                               (int16_t)values[3], (int16_t)values[4]});
+        }
+        writer.writeFrame(records.data(), records.size());
+        expectedFrame++;
+    }
+    //Not left half written, where it could pass for a valid log of fewer frames
+    if (!writer.close()) {
+        std::remove(binaryPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary tracking log (.vclog), the same content as a TXT log in a frame-indexed layout:
+//
+//   BinaryLogHeader
+//   BinaryLogRecord[recordCount]       records of frame 1, then frame 2, ...
+//   uint32_t frameStart[frameCount + 1] index of the first record of every frame, then recordCount
+//
+// Everything is in host byte order (little-endian on every platform we build for); the magic number
+// doubles as the byte-order check. Frames are numbered from 1 like the TXT log lines.
+
+const char BINARY_LOG_MAGIC[4] = {'V', 'C', 'L', 'G'};
+const uint16_t BINARY_LOG_VERSION = 1;
+
+struct BinaryLogHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t frameCount;
+    uint32_t recordCount;
+    uint64_t frameTableOffset;
+};
+
+// One live track in one frame. Coordinates are 16-bit, which covers frames up to 32767 pixels wide.
+struct BinaryLogRecord {
+    uint32_t id;
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+};
+
+static_assert(sizeof(BinaryLogHeader) == 24, "BinaryLogHeader must have no padding");
+static_assert(sizeof(BinaryLogRecord) == 12, "BinaryLogRecord must have no padding");
+
+// Streams frames to a .vclog file. The frame table is kept in memory and appended by close().
+class BinaryLogWriter {
+public:
+    ~BinaryLogWriter() { close(); }
+
+    bool open(const std::string &path);
+    // Appends the next frame.
+    bool writeFrame(const BinaryLogRecord *records, size_t count);
+    // Frames written so far, including those of the run resumed
+    uint32_t frames() const { return frameStart.empty() ? 0 : (uint32_t)(frameStart.size() - 1); }
+    // Finishes the file; returns false if anything failed since open().
+    bool close();
+    // Gives the file up unfinished: closes and deletes it (and its frame table) instead of writing the header.
+    void discard();
+
+    // Flushes the records and appends the frame table entries added since the last checkpoint to
+    // "<path>.frames", so that the log can be resumed at this point. frames and records describe it.
+    bool checkpoint(uint32_t &frames, uint32_t &records);
+    // Reopens a log left unfinished after checkpoint(frames, records), dropping anything written later.
+    bool resume(const std::string &path, uint32_t frames, uint32_t records);
+
+private:
+    std::string path;
+    std::ofstream file;
+    std::vector<uint32_t> frameStart;
+    size_t checkpointedFrames = 0;      // frame table entries already in "<path>.frames"
+    uint32_t recordCount = 0;
+    bool failed = false;
+};
+
+// Read-only view of a .vclog file mapped into memory; records are used in place, nothing is parsed.
+class BinaryLogReader {
+public:
+    BinaryLogReader() = default;
+    BinaryLogReader(const BinaryLogReader &) = delete;
+    BinaryLogReader &operator=(const BinaryLogReader &) = delete;
+    ~BinaryLogReader() { close(); }
+
+    // False if the file cannot be mapped or is not a valid log.
+    bool open(const std::string &path);
+    void close();
+
+    int frames() const { return header ? (int)header->frameCount : 0; }
+    // Records of frame 1..frames()
+    const BinaryLogRecord *begin(int frame) const { return records + frameStart[frame - 1]; }
+    const BinaryLogRecord *end(int frame) const { return records + frameStart[frame]; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+    const BinaryLogHeader *header = nullptr;
+    const BinaryLogRecord *records = nullptr;
+    const uint32_t *frameStart = nullptr;
+};
+
+// Whether a coordinate fits the 16-bit fields of BinaryLogRecord
+inline bool fitsBinaryLogRecord(long value) {
+    return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+// Converts a TXT log ("<frame> [<id> <x> <y> <width> <height> ]...") to a .vclog file.
+// On failure no file is left at binaryPath.
+bool convertTxtLogToBinary(const std::string &txtPath, const std::string &binaryPath);
+
+#endif    // BINARY_LOG_H
@@ -10,9 +10,12 @@
 */
 #include "Blob.h"
 
-Blob::Blob(std::vector<cv::Point> _contour) {
-    currentContour = _contour;
-    currentBoundingRect = cv::boundingRect(currentContour);
+Blob::Blob(const std::vector<cv::Point> &_contour) : Blob(cv::boundingRect(_contour)) {
+}
+
+
+Blob::Blob(const cv::Rect &_boundingRect) {
+    currentBoundingRect = _boundingRect;
 
     cv::Point currentCenter;
 
@@ -28,6 +31,12 @@ Blob::Blob(std::vector<cv::Point> _contour) {
     blnCurrentMatchFoundOrNewBlob = true;
 
     intNumOfConsecutiveFramesWithoutAMatch = 0;
+
+    intId = -1;
+    intFirstFrame = 0;
+    intLastFrame = 0;
+    dblPathLength = 0.0;
+    countedLines = 0;
 }
 
 
@@ -14,21 +14,63 @@
 #include<opencv2/highgui/highgui.hpp>
 #include<opencv2/imgproc/imgproc.hpp>
 
+// Centers of a track: the last CAPACITY of them (all predictNextPosition looks at), the first one
+// and how many there were, so a track's memory does not grow with its age.
+class CenterHistory {
+	public:
+		static const int CAPACITY = 5;
+
+		void push_back(const cv::Point &center) {
+			if (count == 0) {
+				firstCenter = center;
+			}
+			centers[count % CAPACITY] = center;
+			count++;
+		}
+		// number of kept centers, at most CAPACITY
+		int size(void) const { return count < CAPACITY ? count : CAPACITY; }
+		// i-th kept center, oldest first
+		const cv::Point &operator[](int i) const { return centers[(count - size() + i) % CAPACITY]; }
+		const cv::Point &back(void) const { return centers[(count - 1) % CAPACITY]; }
+		const cv::Point &first(void) const { return firstCenter; }
+		long total(void) const { return count; }
+		// puts back a history saved as first(), the kept centers (oldest first) and total()
+		void restore(const cv::Point &first, const std::vector<cv::Point> &kept, long total) {
+			count = total - (long)kept.size();
+			for (const auto &center : kept) {
+				push_back(center);
+			}
+			firstCenter = first;
+		}
+
+	private:
+		cv::Point centers[CAPACITY];
+		cv::Point firstCenter;
+		long count = 0;
+};
+
 class Blob {
 	public:
 		// member variables
-		std::vector<cv::Point> currentContour;
+		int intId;
+		int intFirstFrame;
+		int intLastFrame;
 		cv::Rect currentBoundingRect;
-		std::vector<cv::Point> centerPositions;
+		CenterHistory centerPositions;
+		double dblPathLength;
 		double dblCurrentDiagonalSize;
 		double dblCurrentAspectRatio;
 		bool blnCurrentMatchFoundOrNewBlob;
 		bool blnStillBeingTracked;
 		int intNumOfConsecutiveFramesWithoutAMatch;
 		cv::Point predictedNextPosition;
+		// bit i set once the track has been counted on count line i
+		unsigned long long countedLines;
 
 		// function prototypes
-		Blob(std::vector<cv::Point> _contour);
+		// the contour is only measured, not kept
+		Blob(const std::vector<cv::Point> &_contour);
+		explicit Blob(const cv::Rect &_boundingRect);
 		void predictNextPosition(void);
 };
 
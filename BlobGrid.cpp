@@ -0,0 +1,44 @@
+#include "BlobGrid.h"
+#include <cmath>
+#include <cstdint>
+
+
+void BlobGrid::build(const std::vector<Blob> &blobs) {
+    entries.clear();
+    for (unsigned int i = 0; i < blobs.size(); i++) {
+        if (blobs[i].blnStillBeingTracked) {
+            const cv::Point &position = blobs[i].predictedNextPosition;
+            entries.emplace_back(cellKey(cellOf(position.x), cellOf(position.y)), i);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+}
+
+
+void BlobGrid::insert(int index, const cv::Point &position) {
+    std::pair<long long, int> entry(cellKey(cellOf(position.x), cellOf(position.y)), index);
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry), entry);
+}
+
+
+int BlobGrid::nearest(const std::vector<Blob> &blobs, const cv::Point &point, double radius) const {
+    int best = -1;
+    double bestDistance = radius;
+    forEachWithin(blobs, point, radius, [&](int index, double distance) {
+        if (distance < bestDistance || (distance == bestDistance && index < best)) {
+            best = index;
+            bestDistance = distance;
+        }
+    });
+    return best;
+}
+
+
+long long BlobGrid::cellKey(int cellX, int cellY) const {
+    return ((long long)cellX << 32) | (uint32_t)cellY;
+}
+
+
+int BlobGrid::cellOf(double coordinate) const {
+    return (int)std::floor(coordinate / cellSize);
+}
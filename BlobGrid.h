@@ -0,0 +1,59 @@
+#ifndef BLOB_GRID_H
+#define BLOB_GRID_H
+
+#include "Blob.h"
+#include "Tracking.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Smaller cells gain nothing: a query visits about (2 * radius / cellSize)^2 of them
+const int MIN_GRID_CELL_SIZE = 16;
+
+// Uniform grid over the predicted positions of live tracks, so matching a detection only looks at
+// tracks in nearby cells instead of every blob ever seen.
+class BlobGrid {
+public:
+    explicit BlobGrid(int cellSize = 256) : cellSize(cellSize) {}
+
+    // Indexes every blob that is still being tracked by its predictedNextPosition.
+    void build(const std::vector<Blob> &blobs);
+    void insert(int index, const cv::Point &position);
+
+    // Calls visit(index, distance) for every indexed blob strictly closer than radius to point.
+    template<typename Visitor>
+    void forEachWithin(const std::vector<Blob> &blobs, const cv::Point &point, double radius, Visitor visit) const;
+
+    // Nearest indexed blob strictly closer than radius, lowest index on ties (like a linear scan), or -1.
+    int nearest(const std::vector<Blob> &blobs, const cv::Point &point, double radius) const;
+
+private:
+    long long cellKey(int cellX, int cellY) const;
+    int cellOf(double coordinate) const;
+
+    int cellSize;
+    // (cell key, blob index), sorted, so the grid needs no per-cell containers
+    std::vector<std::pair<long long, int>> entries;
+};
+
+
+template<typename Visitor>
+void BlobGrid::forEachWithin(const std::vector<Blob> &blobs, const cv::Point &point, double radius,
+                             Visitor visit) const {
+    int firstX = cellOf(point.x - radius), lastX = cellOf(point.x + radius);
+    int firstY = cellOf(point.y - radius), lastY = cellOf(point.y + radius);
+    for (int cellY = firstY; cellY <= lastY; cellY++) {
+        for (int cellX = firstX; cellX <= lastX; cellX++) {
+            long long key = cellKey(cellX, cellY);
+            auto it = std::lower_bound(entries.begin(), entries.end(), std::make_pair(key, -1));
+            for (; it != entries.end() && it->first == key; ++it) {
+                double distance = distanceBetweenPoints(point, blobs[it->second].predictedNextPosition);
+                if (distance < radius) {
+                    visit(it->second, distance);
+                }
+            }
+        }
+    }
+}
+
+#endif    // BLOB_GRID_H
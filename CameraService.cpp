@@ -0,0 +1,768 @@
+#include "CameraService.h"
+#include "MotionDetector.h"
+#include "VideoLog.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+//Messages of cameras come from pool workers and capture threads
+static std::mutex outputMutex;
+
+const std::string FAKE_PREFIX = "fake:";
+
+
+const char *priorityName(CameraPriority priority) {
+    switch (priority) {
+        case CameraPriority::High:
+            return "high";
+        case CameraPriority::Low:
+            return "low";
+        default:
+            return "normal";
+    }
+}
+
+
+//"north=fake:north.avi,priority=high,slo=200"
+bool parseCameraSpec(const std::string &value, CameraSpec &spec, std::string &error) {
+    std::istringstream ss(value);
+    std::string camera;
+    std::getline(ss, camera, ',');
+    size_t equals = camera.find('=');
+    if (equals == std::string::npos || equals == 0 || equals + 1 == camera.size()) {
+        error = "A camera is <id>=<source>[,priority=high|normal|low][,slo=ms]: " + value;
+        return false;
+    }
+    spec = CameraSpec();
+    spec.id = camera.substr(0, equals);
+    spec.source = camera.substr(equals + 1);
+    if (spec.id.find_first_of("/ \t") != std::string::npos) {
+        error = "Camera ids name their logs, no '/' or spaces: " + spec.id;
+        return false;
+    }
+    std::string setting;
+    while (std::getline(ss, setting, ',')) {
+        size_t split = setting.find('=');
+        std::string key = setting.substr(0, split);
+        std::string setValue = split == std::string::npos ? "" : setting.substr(split + 1);
+        if (key == "priority" && setValue == "high") {
+            spec.priority = CameraPriority::High;
+        } else if (key == "priority" && setValue == "normal") {
+            spec.priority = CameraPriority::Normal;
+        } else if (key == "priority" && setValue == "low") {
+            spec.priority = CameraPriority::Low;
+        } else if (key == "slo") {
+            try {
+                spec.sloMs = std::stod(setValue);
+            } catch (const std::logic_error &) {
+                spec.sloMs = -1.0;
+            }
+            if (!(spec.sloMs > 0)) {
+                error = "slo must be a positive number of milliseconds: " + setting;
+                return false;
+            }
+        } else {
+            error = "Unknown camera setting " + setting;
+            return false;
+        }
+    }
+    spec.fake = spec.source.compare(0, FAKE_PREFIX.size(), FAKE_PREFIX) == 0;
+    return true;
+}
+
+
+//One camera: a capture thread fills the buffer, pool tasks empty it one frame each. A task is queued when a
+//frame arrives and none is (scheduled), and queues the next one itself while frames are left, so the
+//tracker state is only ever used by one task at a time.
+class ServiceCamera {
+public:
+    ServiceCamera(const CameraSpec &spec, const BatchOptions &options, WorkStealingPool &pool, size_t home);
+    ~ServiceCamera();
+
+    bool start(std::string &error);
+    // Stops capturing, waits for the buffered frames to be tracked and finishes the logs; false if a log failed
+    bool stop();
+    // The source ended (or tracking failed) and nothing is left to track
+    bool ended();
+    std::string status();
+
+    const CameraSpec spec;
+
+private:
+    struct CapturedFrame {
+        cv::Mat frame;
+        long sequence = 0;
+        int64_t captureTimeMs = 0;
+        Clock::time_point captured;
+        long loop = 0;              // times a fake camera's file started over before this frame
+    };
+
+    void capture();
+    void step();
+
+    const BatchOptions &options;
+    WorkStealingPool &pool;
+    const size_t home;
+    const double sloMs;
+
+    cv::VideoCapture videoCapture;
+    std::thread captureThread;
+    std::vector<std::unique_ptr<TrackSink>> sinks;
+
+    //Used by one task at a time
+    std::unique_ptr<MotionDetector> detector;
+    long trackedLoop = 0;
+    TrackerState tracks;
+    std::vector<Blob> curFrameBlobs;
+    ContourBuffers contourBuffers;
+    SinkFrame sinkFrame;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<CapturedFrame> buffer;
+    std::vector<cv::Mat> freeFrames;
+    bool scheduled = false;
+    bool stopCapture = false;
+    bool captureEnded = false;
+    bool failed = false;
+    CameraStats stats;
+};
+
+
+ServiceCamera::ServiceCamera(const CameraSpec &spec, const BatchOptions &options, WorkStealingPool &pool,
+                             size_t home)
+        : spec(spec), options(options), pool(pool), home(home),
+          sloMs(spec.sloMs > 0 ? spec.sloMs : options.stream.latencyBudgetMs) {
+}
+
+
+ServiceCamera::~ServiceCamera() {
+    if (captureThread.joinable()) {
+        stop();
+    }
+}
+
+
+bool ServiceCamera::start(std::string &error) {
+    videoCapture.open(spec.fake ? spec.source.substr(FAKE_PREFIX.size()) : spec.source);
+    if (!videoCapture.isOpened()) {
+        error = spec.id + ": cannot open " + spec.source;
+        return false;
+    }
+    mkdir(options.outputDir.c_str(), S_IRWXU);
+    for (int code : options.logTypeCodes) {
+        sinks.push_back(makeFileSink(code, options.outputDir + "/" + spec.id + logTypes[code]));
+    }
+    if (options.nullSink) {
+        sinks.emplace_back(new NullSink());
+    }
+    if (!options.params.countLines.empty()) {
+        sinks.emplace_back(new CountSink(options.outputDir + "/" + spec.id + COUNTS_EXT, options.params.countLines,
+                                         options.countBucketSeconds, videoCapture.get(CV_CAP_PROP_FPS)));
+    }
+    for (auto &sink : sinks) {
+        if (!sink || !sink->open()) {
+            error = spec.id + ": cannot open " + (sink ? sink->name() : "its log");
+            return false;
+        }
+    }
+    detector = createMotionDetector(options.params);
+    captureThread = std::thread(&ServiceCamera::capture, this);
+    return true;
+}
+
+
+//As trackStream's capture thread; a fake camera is paced at the file's frame rate and loops
+void ServiceCamera::capture() {
+    double fps = videoCapture.get(CV_CAP_PROP_FPS);
+    if (!(fps > 0)) {
+        fps = 25.0;
+    }
+    const size_t bufferFrames = (size_t)std::max(1, options.stream.bufferFrames);
+    Clock::time_point start = Clock::now();
+    for (long sequence = 0; !streamStopRequested(); sequence++) {
+        if (spec.fake) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(sequence / fps)));
+        }
+        CapturedFrame item;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopCapture) {
+                break;
+            }
+            if (!freeFrames.empty()) {
+                item.frame = std::move(freeFrames.back());
+                freeFrames.pop_back();
+            }
+        }
+        {
+            VC_TIME_STAGE(Decode);
+            bool read = videoCapture.read(item.frame) && !item.frame.empty();
+            if (!read && spec.fake && videoCapture.set(CV_CAP_PROP_POS_FRAMES, 0)) {
+                read = videoCapture.read(item.frame) && !item.frame.empty();
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.restarts++;
+            }
+            if (!read) {
+                break;
+            }
+        }
+        item.captured = Clock::now();
+        item.sequence = sequence;
+        item.captureTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        stats.captured++;
+        item.loop = stats.restarts;
+        if (failed) {
+            break;
+        }
+        if (buffer.size() >= bufferFrames) {
+            switch (options.stream.dropPolicy) {
+                case DropPolicy::Block:
+                    changed.wait(lock, [&] { return buffer.size() < bufferFrames || stopCapture || failed; });
+                    break;
+                case DropPolicy::DropOldest:
+                    freeFrames.push_back(std::move(buffer.front().frame));
+                    buffer.pop_front();
+                    stats.dropped++;
+                    break;
+                case DropPolicy::Latest:
+                    for (auto &dropped : buffer) {
+                        freeFrames.push_back(std::move(dropped.frame));
+                    }
+                    stats.dropped += buffer.size();
+                    buffer.clear();
+                    break;
+            }
+        }
+        buffer.push_back(std::move(item));
+        if (!scheduled) {
+            scheduled = true;
+            pool.submit((int)spec.priority, home, [this] { step(); });
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    captureEnded = true;
+    changed.notify_all();
+}
+
+
+void ServiceCamera::step() {
+    CapturedFrame item;
+    bool newerWaiting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        VC_OBSERVE(StreamBuffer, buffer.size());
+        item = std::move(buffer.front());
+        buffer.pop_front();
+        newerWaiting = !buffer.empty();
+        changed.notify_all();
+    }
+
+    //Frames past the SLO are skipped while a newer one waits, as --latency-budget does for streams
+    double ageMs = std::chrono::duration<double, std::milli>(Clock::now() - item.captured).count();
+    bool skip = options.stream.dropPolicy != DropPolicy::Block && newerWaiting && ageMs > sloMs;
+    bool logged = false;
+    bool error = false;
+    if (!skip) {
+        try {
+            //The end and the start of a looping file are no consecutive frames
+            if (item.loop != trackedLoop) {
+                detector->reset();
+                trackedLoop = item.loop;
+            }
+            if (detector->apply(item.frame)) {
+                curFrameBlobs.clear();
+                if (detector->moved()) {
+                    extractBlobs(detector->mask(), item.frame.size(), curFrameBlobs, options.params, contourBuffers);
+                }
+                matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, options.params);
+                fillSinkFrame((int)item.sequence, tracks, sinkFrame, item.captureTimeMs);
+                for (auto &sink : sinks) {
+                    VC_TIME_STAGE(SinkWrite);
+                    sink->write(sinkFrame);
+                }
+                logged = true;
+            }
+        } catch (const cv::Exception &e) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cerr << spec.id << ": " << e.msg << std::endl;
+            error = true;
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cerr << spec.id << ": " << e.what() << std::endl;
+            error = true;
+        }
+    }
+    double lagMs = std::chrono::duration<double, std::milli>(Clock::now() - item.captured).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (skip) {
+        stats.skipped++;
+    } else if (logged) {
+        stats.processed++;
+        stats.totalLagMs += lagMs;
+        stats.maxLagMs = std::max(stats.maxLagMs, lagMs);
+        stats.sloMisses += lagMs > sloMs;
+    }
+    freeFrames.push_back(std::move(item.frame));
+    if (error) {
+        //Nothing more is tracked; the capture thread stops at its next frame
+        failed = true;
+        for (auto &dropped : buffer) {
+            freeFrames.push_back(std::move(dropped.frame));
+        }
+        buffer.clear();
+    }
+    if (!buffer.empty()) {
+        pool.submit((int)spec.priority, home, [this] { step(); });
+    } else {
+        scheduled = false;
+    }
+    changed.notify_all();
+}
+
+
+bool ServiceCamera::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopCapture = true;
+        changed.notify_all();
+    }
+    if (captureThread.joinable()) {
+        captureThread.join();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !scheduled; });
+    }
+    bool ok = !failed;
+    for (auto &sink : sinks) {
+        try {
+            if (!sink->finish()) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cerr << spec.id << ": cannot finish " << sink->name() << std::endl;
+                ok = false;
+            }
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cerr << spec.id << ": " << e.what() << std::endl;
+            ok = false;
+        }
+    }
+    sinks.clear();
+    videoCapture.release();
+    return ok;
+}
+
+
+bool ServiceCamera::ended() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (captureEnded || failed) && !scheduled;
+}
+
+
+std::string ServiceCamera::status() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream line;
+    line << spec.id << " " << spec.source << ": " << priorityName(spec.priority) << ", slo " << sloMs << " ms, "
+         << (failed ? "failed" : captureEnded ? (scheduled ? "ending" : "ended") : "running") << "; "
+         << stats.captured << " captured, " << stats.processed << " tracked, " << stats.dropped << " dropped, "
+         << stats.skipped << " skipped, " << stats.sloMisses << " late, lag avg "
+         << (stats.processed > 0 ? stats.totalLagMs / stats.processed : 0.0) << " ms, max " << stats.maxLagMs
+         << " ms, " << buffer.size() << " buffered";
+    if (spec.fake) {
+        line << ", " << stats.restarts << " restarts";
+    }
+    return line.str();
+}
+
+
+CameraService::CameraService(const BatchOptions &options, const ServiceOptions &service)
+        : options(options), service(service),
+          pool(service.threads > 0 ? service.threads : (int)std::max(1u, std::thread::hardware_concurrency()),
+               (int)CameraPriority::Count) {
+}
+
+
+CameraService::~CameraService() {
+    removeAll();
+}
+
+
+bool CameraService::removeAll() {
+    std::vector<std::string> ids;
+    {
+        std::lock_guard<std::mutex> lock(camerasMutex);
+        for (const auto &camera : cameras) {
+            ids.push_back(camera.first);
+        }
+    }
+    bool ok = true;
+    std::string error;
+    for (const auto &id : ids) {
+        ok = removeCamera(id, error) && ok;
+    }
+    return ok;
+}
+
+
+bool CameraService::addCamera(const CameraSpec &spec, std::string &error) {
+    std::unique_ptr<ServiceCamera> camera;
+    {
+        std::lock_guard<std::mutex> lock(camerasMutex);
+        if (cameras.count(spec.id)) {
+            error = "Camera " + spec.id + " is already running";
+            return false;
+        }
+        camera.reset(new ServiceCamera(spec, options, pool, nextHome++));
+    }
+    //Opening a network source can take a while, so it is done without holding the camera list
+    if (!camera->start(error)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(camerasMutex);
+    if (cameras.count(spec.id)) {
+        camera->stop();
+        error = "Camera " + spec.id + " is already running";
+        return false;
+    }
+    cameras[spec.id] = std::move(camera);
+    return true;
+}
+
+
+bool CameraService::removeCamera(const std::string &id, std::string &error) {
+    std::unique_ptr<ServiceCamera> camera;
+    {
+        std::lock_guard<std::mutex> lock(camerasMutex);
+        auto found = cameras.find(id);
+        if (found == cameras.end()) {
+            error = "No camera " + id;
+            return false;
+        }
+        camera = std::move(found->second);
+        cameras.erase(found);
+    }
+    bool ok = camera->stop();
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::cout << "removed " << camera->status() << std::endl;
+    if (!ok) {
+        error = id + ": logging failed";
+    }
+    return ok;
+}
+
+
+std::string CameraService::status() {
+    std::ostringstream lines;
+    std::lock_guard<std::mutex> lock(camerasMutex);
+    for (const auto &camera : cameras) {
+        lines << camera.second->status() << "\n";
+    }
+    lines << "pool: " << pool.threads() << " threads, " << cameras.size() << " cameras, queued";
+    for (int level = 0; level < (int)CameraPriority::Count; level++) {
+        lines << " " << priorityName((CameraPriority)level) << " " << pool.queued(level);
+    }
+    lines << ", " << pool.stolen() << " stolen\n";
+    return lines.str();
+}
+
+
+//"add <spec>", "remove <id>", "status" or "shutdown"; reply is what goes back before the final "ok"
+bool CameraService::command(const std::string &line, std::string &reply) {
+    std::istringstream ss(line);
+    std::string verb, argument;
+    ss >> verb;
+    std::getline(ss >> std::ws, argument);
+    if (verb == "add") {
+        CameraSpec spec;
+        return parseCameraSpec(argument, spec, reply) && addCamera(spec, reply);
+    }
+    if (verb == "remove") {
+        return removeCamera(argument, reply);
+    }
+    if (verb == "status") {
+        reply = status();
+        return true;
+    }
+    if (verb == "shutdown") {
+        shutdownRequested = true;
+        return true;
+    }
+    reply = "Unknown command " + verb + " (add <id>=<source>[,priority=p][,slo=ms], remove <id>, status, shutdown)";
+    return false;
+}
+
+
+static bool writeAll(int fd, const std::string &text) {
+    size_t written = 0;
+    while (written < text.size()) {
+        ssize_t n = ::write(fd, text.data() + written, text.size() - written);
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+
+//One connection at a time. Each command line is answered with any output lines, then "ok" or "error: ..."
+int CameraService::serveControlSocket() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (service.controlPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Control socket path too long: " << service.controlPath << std::endl;
+        return 2;
+    }
+    std::strcpy(address.sun_path, service.controlPath.c_str());
+    //Only a socket left by an earlier run is replaced, never a file --control named by mistake
+    struct stat existing;
+    if (lstat(service.controlPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << service.controlPath << " exists and is not a socket" << std::endl;
+            return 2;
+        }
+        unlink(service.controlPath.c_str());
+    }
+    //Commands start and stop sources, so only this user may connect. Nobody can connect before listen(), so
+    //the mode is set in between.
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0 ||
+        chmod(service.controlPath.c_str(), S_IRUSR | S_IWUSR) < 0 || listen(listener, 4) < 0) {
+        std::cerr << "Cannot listen on " << service.controlPath << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+    std::cout << "control socket " << service.controlPath << std::endl;
+
+    auto lastReport = Clock::now();
+    auto report = [&] {
+        if (options.stream.reportSeconds > 0 &&
+            std::chrono::duration<double>(Clock::now() - lastReport).count() >= options.stream.reportSeconds) {
+            std::string lines = status();
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << lines;
+            lastReport = Clock::now();
+        }
+    };
+    int client = -1;
+    std::string received;
+    while (!shutdownRequested && !streamStopRequested()) {
+        report();
+        pollfd waiting = {client >= 0 ? client : listener, POLLIN, 0};
+        if (poll(&waiting, 1, 200) <= 0) {
+            continue;
+        }
+        if (client < 0) {
+            client = accept(listener, nullptr, nullptr);
+            received.clear();
+            continue;
+        }
+        char chunk[4096];
+        ssize_t n = read(client, chunk, sizeof(chunk));
+        if (n <= 0) {
+            close(client);
+            client = -1;
+            continue;
+        }
+        received.append(chunk, n);
+        size_t end;
+        while ((end = received.find('\n')) != std::string::npos && !shutdownRequested) {
+            std::string line = received.substr(0, end);
+            received.erase(0, end + 1);
+            line.erase(line.find_last_not_of(" \r") + 1);
+            if (line.empty()) {
+                continue;
+            }
+            std::string reply;
+            bool ok = command(line, reply);
+            if (!ok) {
+                reply = "error: " + reply + "\n";
+            } else {
+                reply += "ok\n";
+            }
+            if (!writeAll(client, reply)) {
+                break;
+            }
+        }
+    }
+    if (client >= 0) {
+        close(client);
+    }
+    close(listener);
+    unlink(service.controlPath.c_str());
+    return 0;
+}
+
+
+int CameraService::run() {
+    if (!service.controlPath.empty()) {
+        return serveControlSocket();
+    }
+    auto lastReport = Clock::now();
+    while (!streamStopRequested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        bool running = false;
+        {
+            std::lock_guard<std::mutex> lock(camerasMutex);
+            for (const auto &camera : cameras) {
+                running = running || !camera.second->ended();
+            }
+        }
+        if (!running) {
+            break;
+        }
+        if (options.stream.reportSeconds > 0 &&
+            std::chrono::duration<double>(Clock::now() - lastReport).count() >= options.stream.reportSeconds) {
+            std::string lines = status();
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << lines;
+            lastReport = Clock::now();
+        }
+    }
+    return 0;
+}
+
+
+void printServiceUsage(const char *program) {
+    std::cout << "Usage: " << program << " serve [options] [--camera <spec>]... [<source>|fake:<video>]..." << std::endl
+              << "Tracks many cameras at once on one shared thread pool until SIGINT/SIGTERM, the shutdown command" << std::endl
+              << "or, without a control socket, the end of every source. Logs go to <output-dir>/<id>.<format>." << std::endl
+              << std::endl
+              << "  --camera <id>=<source>[,priority=high|normal|low][,slo=ms]" << std::endl
+              << "                               a camera (repeatable); sources given alone get their file name" << std::endl
+              << "                               as id, normal priority and --latency-budget as SLO" << std::endl
+              << "  --threads <n>                worker threads shared by all cameras (default: one per core)" << std::endl
+              << "  --control <path>             Unix socket taking \"add <spec>\", \"remove <id>\", \"status\" and" << std::endl
+              << "                               \"shutdown\" lines, e.g. with socat - UNIX-CONNECT:<path>" << std::endl
+              << std::endl
+              << "A source fake:<video> plays a video file as a camera: at its frame rate, looping at its end." << std::endl
+              << "--drop, --stream-buffer and --latency-budget apply per camera, --stream-report prints the status." << std::endl
+              << "File log formats, detection, matching, count line and metrics options are those of batch mode" << std::endl
+              << "(" << program << " --help)." << std::endl;
+}
+
+
+int runService(int argc, char **argv) {
+    //Service options are taken out here, everything else is parsed as in batch mode
+    ServiceOptions service;
+    std::vector<char *> batchArgs = {argv[0]};
+    std::string error;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printServiceUsage(argv[0]);
+            return 0;
+        }
+        if (arg != "--camera" && arg != "--control" && arg != "--threads") {
+            batchArgs.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "Missing value for " + arg;
+            break;
+        }
+        std::string value = argv[++i];
+        if (arg == "--camera") {
+            CameraSpec spec;
+            if (!parseCameraSpec(value, spec, error)) {
+                break;
+            }
+            service.cameras.push_back(spec);
+        } else if (arg == "--control") {
+            service.controlPath = value;
+        } else {
+            try {
+                service.threads = std::stoi(value);
+            } catch (const std::logic_error &) {
+                service.threads = -1;
+            }
+            if (service.threads < 1) {
+                error = "--threads must be at least 1";
+                break;
+            }
+        }
+    }
+
+    BatchOptions options;
+    if (error.empty()) {
+        parseBatchOptions((int)batchArgs.size(), batchArgs.data(), options, error);
+    }
+    if (error.empty()) {
+        if (std::find(options.logTypeCodes.begin(), options.logTypeCodes.end(), TYPES_NUMBER) !=
+            options.logTypeCodes.end()) {
+            error = "serve writes file logs only, not the database";
+        } else if (options.jobs != 1 || options.params.pipelined) {
+            error = "serve runs every camera on the shared pool: use --threads instead of --jobs and --pipeline";
+        } else if (options.segments.segments > 1 || options.checkpointSeconds > 0 || options.params.frameStride > 1 ||
+                   options.decoder.luma || options.validateFused || options.convertLogs ||
+                   !options.expectedLog.empty()) {
+            error = "serve tracks live cameras: no segments, checkpoints, strides, luma decoding or file checks";
+        }
+    }
+    for (const auto &input : options.inputs) {
+        CameraSpec spec;
+        spec.source = input;
+        spec.fake = input.compare(0, FAKE_PREFIX.size(), FAKE_PREFIX) == 0;
+        std::string name = logNameFromPath(spec.fake ? input.substr(FAKE_PREFIX.size()) : input);
+        spec.id = name.empty() ? "camera" : name;
+        for (int n = 2; std::any_of(service.cameras.begin(), service.cameras.end(),
+                                    [&](const CameraSpec &other) { return other.id == spec.id; }); n++) {
+            spec.id = name + "_" + std::to_string(n);
+        }
+        service.cameras.push_back(spec);
+    }
+    if (error.empty() && service.cameras.empty() && service.controlPath.empty()) {
+        error = "No cameras given and no --control socket to add them";
+    }
+    if (!error.empty()) {
+        std::cerr << error << std::endl;
+        printServiceUsage(argv[0]);
+        return 2;
+    }
+
+    installStreamStopHandlers();
+    //The pool is the thread budget, so OpenCV must not start threads of its own in every task
+    cv::setNumThreads(1);
+    std::unique_ptr<MetricsExporter> metrics;
+    if (!options.metricsPath.empty()) {
+        metrics.reset(new MetricsExporter(options.metricsPath, options.metricsIntervalSeconds));
+    }
+    bool ok = true;
+    int code;
+    {
+        CameraService cameraService(options, service);
+        for (const auto &spec : service.cameras) {
+            if (!cameraService.addCamera(spec, error)) {
+                std::cerr << error << std::endl;
+                ok = false;
+            }
+        }
+        code = cameraService.run();
+        std::cout << cameraService.status();
+        ok = cameraService.removeAll() && ok;
+    }
+    return code != 0 ? code : ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#ifndef CAMERA_SERVICE_H
+#define CAMERA_SERVICE_H
+
+#include "BatchMode.h"
+#include "WorkStealingPool.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Pool levels of the cameras: when the pool falls behind, lower levels wait and drop frames first.
+enum class CameraPriority {
+    High,
+    Normal,
+    Low,
+    Count
+};
+
+// One camera of the service: "<id>=<source>[,priority=high|normal|low][,slo=ms]". A source starting with
+// "fake:" is a video file played as a camera: at its own frame rate, from the start again at its end.
+struct CameraSpec {
+    std::string id;
+    std::string source;
+    CameraPriority priority = CameraPriority::Normal;
+    // Latency objective from capture to logged frame; 0 for the service's --latency-budget
+    double sloMs = 0.0;
+    bool fake = false;
+};
+
+bool parseCameraSpec(const std::string &value, CameraSpec &spec, std::string &error);
+const char *priorityName(CameraPriority priority);
+
+struct CameraStats {
+    long captured = 0;
+    long processed = 0;
+    long dropped = 0;       // discarded on capture because the camera's buffer was full
+    long skipped = 0;       // taken from the buffer past the SLO while a newer frame was waiting
+    long sloMisses = 0;     // tracked and logged, but later than the SLO
+    long restarts = 0;      // fake cameras: times the file started over
+    double totalLagMs = 0.0;
+    double maxLagMs = 0.0;
+};
+
+struct ServiceOptions {
+    // Worker threads shared by all cameras, 0 for one per core
+    int threads = 0;
+    // Unix socket path of the control connection, empty for none
+    std::string controlPath;
+    std::vector<CameraSpec> cameras;
+};
+
+class ServiceCamera;
+
+// Tracks many cameras at once on one WorkStealingPool. Every camera has a capture thread filling a small
+// buffer (as --stream does), its own detector, tracker state and logs (<output-dir>/<id>.<format>), and at
+// most one task in the pool at a time, which tracks and logs its next buffered frame. Cameras are added and
+// removed while others run, from the command line and the control socket.
+class CameraService {
+public:
+    CameraService(const BatchOptions &options, const ServiceOptions &service);
+    // Removes every camera left (removeAll)
+    ~CameraService();
+
+    bool addCamera(const CameraSpec &spec, std::string &error);
+    // Stops the capture, tracks the frames still buffered and finishes the logs
+    bool removeCamera(const std::string &id, std::string &error);
+    // Removes every camera; false if any of their logs failed
+    bool removeAll();
+    // One line per camera, then the pool
+    std::string status();
+
+    // Answers the control socket until "shutdown" or SIGINT/SIGTERM. Without a socket, returns once every
+    // camera has ended (or on a signal). Returns the process exit code.
+    int run();
+
+private:
+    bool command(const std::string &line, std::string &reply);
+    int serveControlSocket();
+
+    const BatchOptions &options;
+    ServiceOptions service;
+    WorkStealingPool pool;
+    std::mutex camerasMutex;
+    std::map<std::string, std::unique_ptr<ServiceCamera>> cameras;
+    size_t nextHome = 0;
+    bool shutdownRequested = false;
+};
+
+// "VehicleCounter_V2 serve [options] [--camera <spec>]... [fake:<video>|<source>]...": tracking and log
+// options as in batch mode, see printServiceUsage.
+int runService(int argc, char **argv);
+void printServiceUsage(const char *program);
+
+#endif    // CAMERA_SERVICE_H
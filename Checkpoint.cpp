@@ -0,0 +1,212 @@
+#include "Checkpoint.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+const std::string CHECKPOINT_MAGIC = "vccheckpoint";
+const int CHECKPOINT_VERSION = 1;
+
+
+static void writePoint(std::ostream &out, const cv::Point &point) {
+    out << " " << point.x << " " << point.y;
+}
+
+
+static void writeRect(std::ostream &out, const cv::Rect &rect) {
+    out << " " << rect.x << " " << rect.y << " " << rect.width << " " << rect.height;
+}
+
+
+static bool readPoint(std::istream &in, cv::Point &point) {
+    return (bool)(in >> point.x >> point.y);
+}
+
+
+static bool readRect(std::istream &in, cv::Rect &rect) {
+    return (bool)(in >> rect.x >> rect.y >> rect.width >> rect.height);
+}
+
+
+bool saveCheckpoint(const std::string &path, const std::string &video, const TrackerState &tracks,
+                    const std::vector<std::string> &sinkStates) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << std::setprecision(17);
+        out << CHECKPOINT_MAGIC << " " << CHECKPOINT_VERSION << "\n"
+            << video << "\n"
+            << "frame " << tracks.frame << " " << tracks.nextId << "\n";
+
+        out << "blobs " << tracks.blobs.size() << "\n";
+        for (const auto &blob : tracks.blobs) {
+            out << blob.intId << " " << blob.intFirstFrame << " " << blob.intLastFrame;
+            writeRect(out, blob.currentBoundingRect);
+            out << " " << blob.dblPathLength << " " << blob.dblCurrentDiagonalSize << " "
+                << blob.dblCurrentAspectRatio << " " << blob.blnCurrentMatchFoundOrNewBlob << " "
+                << blob.blnStillBeingTracked << " " << blob.intNumOfConsecutiveFramesWithoutAMatch;
+            writePoint(out, blob.predictedNextPosition);
+            out << " " << blob.countedLines << " " << blob.centerPositions.total();
+            writePoint(out, blob.centerPositions.first());
+            out << " " << blob.centerPositions.size();
+            for (int i = 0; i < blob.centerPositions.size(); i++) {
+                writePoint(out, blob.centerPositions[i]);
+            }
+            out << "\n";
+        }
+
+        out << "archive " << tracks.archive.size() << "\n";
+        for (const auto &record : tracks.archive) {
+            out << record.id << " " << record.firstFrame << " " << record.lastFrame;
+            writePoint(out, record.firstCenter);
+            writePoint(out, record.lastCenter);
+            writeRect(out, record.lastBoundingRect);
+            out << " " << record.centers << " " << record.pathLength << "\n";
+        }
+
+        out << "lines " << tracks.lineCounts.size() << "\n";
+        for (const auto &counter : tracks.lineCounts) {
+            out << counter.forward.size();
+            for (size_t lane = 0; lane < counter.forward.size(); lane++) {
+                out << " " << counter.forward[lane] << " " << counter.backward[lane];
+            }
+            out << "\n";
+        }
+
+        out << "sinks " << sinkStates.size() << "\n";
+        for (const auto &state : sinkStates) {
+            out << state << "\n";
+        }
+        out << "end\n";
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+
+bool loadCheckpoint(const std::string &path, const std::string &video, TrackerState &tracks,
+                    std::vector<std::string> &sinkStates) {
+    std::ifstream in(path);
+    std::string magic, savedVideo, word;
+    int version;
+    size_t count;
+    if (!(in >> magic >> version) || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+        return false;
+    }
+    in.ignore(1);
+    if (!std::getline(in, savedVideo) || savedVideo != video) {
+        return false;
+    }
+
+    TrackerState state;
+    if (!(in >> word >> state.frame >> state.nextId) || word != "frame" || !(in >> word >> count) || word != "blobs") {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        cv::Rect rect;
+        int id, firstFrame, lastFrame;
+        if (!(in >> id >> firstFrame >> lastFrame) || !readRect(in, rect)) {
+            return false;
+        }
+        Blob blob(rect);
+        blob.intId = id;
+        blob.intFirstFrame = firstFrame;
+        blob.intLastFrame = lastFrame;
+        long total;
+        int kept;
+        cv::Point first;
+        if (!(in >> blob.dblPathLength >> blob.dblCurrentDiagonalSize >> blob.dblCurrentAspectRatio >>
+              blob.blnCurrentMatchFoundOrNewBlob >> blob.blnStillBeingTracked >>
+              blob.intNumOfConsecutiveFramesWithoutAMatch) ||
+            !readPoint(in, blob.predictedNextPosition) || !(in >> blob.countedLines >> total) ||
+            !readPoint(in, first) || !(in >> kept) || kept < 0 || kept > CenterHistory::CAPACITY || kept > total) {
+            return false;
+        }
+        std::vector<cv::Point> centers(kept);
+        for (auto &center : centers) {
+            if (!readPoint(in, center)) {
+                return false;
+            }
+        }
+        blob.centerPositions.restore(first, centers, total);
+        state.blobs.push_back(blob);
+    }
+
+    if (!(in >> word >> count) || word != "archive") {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        TrackRecord record;
+        if (!(in >> record.id >> record.firstFrame >> record.lastFrame) || !readPoint(in, record.firstCenter) ||
+            !readPoint(in, record.lastCenter) || !readRect(in, record.lastBoundingRect) ||
+            !(in >> record.centers >> record.pathLength)) {
+            return false;
+        }
+        state.archive.push_back(record);
+    }
+
+    if (!(in >> word >> count) || word != "lines") {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t lanes;
+        if (!(in >> lanes)) {
+            return false;
+        }
+        LineCounter counter;
+        counter.forward.assign(lanes, 0);
+        counter.backward.assign(lanes, 0);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (!(in >> counter.forward[lane] >> counter.backward[lane])) {
+                return false;
+            }
+        }
+        state.lineCounts.push_back(counter);
+    }
+
+    if (!(in >> word >> count) || word != "sinks") {
+        return false;
+    }
+    in.ignore(1);
+    std::vector<std::string> states(count);
+    for (auto &sinkState : states) {
+        if (!std::getline(in, sinkState)) {
+            return false;
+        }
+    }
+    if (!(in >> word) || word != "end") {
+        return false;
+    }
+    tracks = std::move(state);
+    sinkStates = std::move(states);
+    return true;
+}
+
+
+bool saveFinishedCheckpoint(const std::string &path, const std::string &video) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << CHECKPOINT_MAGIC << " " << CHECKPOINT_VERSION << "\n"
+            << video << "\n"
+            << "finished\n";
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+
+bool isFinishedCheckpoint(const std::string &path, const std::string &video) {
+    std::ifstream in(path);
+    std::string magic, savedVideo, word;
+    int version;
+    if (!(in >> magic >> version) || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+        return false;
+    }
+    in.ignore(1);
+    return std::getline(in, savedVideo) && savedVideo == video && (in >> word) && word == "finished";
+}
@@ -0,0 +1,30 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Tracking.h"
+#include <string>
+#include <vector>
+
+// When and where logTracks saves its progress. A checkpoint holds the tracker state (live tracks, the
+// archive, count line totals, the frame number) and the state of every sink (TrackSink::checkpoint), so a
+// run that died can go on from there instead of frame 1.
+struct CheckpointOptions {
+    std::string path;               // empty: no checkpoints
+    std::string video;              // identifies the input (path and frame count); other checkpoints are ignored
+    double intervalSeconds = 30.0;  // wall clock between checkpoints
+    bool resume = false;            // continue from the checkpoint at path if there is one
+};
+
+// Text file, written to path + ".tmp" and renamed over path. Doubles are written with 17 digits, so a
+// resumed run continues with exactly the state the checkpoint was taken with.
+bool saveCheckpoint(const std::string &path, const std::string &video, const TrackerState &tracks,
+                    const std::vector<std::string> &sinkStates);
+// False if there is no readable checkpoint for video at path.
+bool loadCheckpoint(const std::string &path, const std::string &video, TrackerState &tracks,
+                    std::vector<std::string> &sinkStates);
+// A run that logged video to the end replaces its checkpoint with one saying so, which --resume skips
+// (and loadCheckpoint does not load).
+bool saveFinishedCheckpoint(const std::string &path, const std::string &video);
+bool isFinishedCheckpoint(const std::string &path, const std::string &video);
+
+#endif    // CHECKPOINT_H
@@ -0,0 +1,165 @@
+#include "DbLog.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+
+DbLogWriter::DbLogWriter(pqxx::transaction_base &W, const std::string &tableName, const DbLogOptions &options)
+        : W(W), tableName(tableName), options(options) {
+    this->options.batchFrames = std::max(1, options.batchFrames);
+}
+
+
+void DbLogWriter::writeFrame(const SinkFrame &frame) {
+    for (const auto &track : frame.tracks) {
+        pending.push_back({frame.frameNumber, track.id, track.x, track.y, track.width, track.height});
+    }
+    if (++pendingFrames >= options.batchFrames) {
+        flush();
+    }
+}
+
+
+void DbLogWriter::flush() {
+    if (!pending.empty()) {
+#ifdef VC_HAVE_STREAM_TO
+        if (options.useCopy) {
+            copyRows();
+        } else {
+            insertRows();
+        }
+#else
+        insertRows();
+#endif
+        rowCount += pending.size();
+    }
+    pending.clear();
+    pendingFrames = 0;
+}
+
+
+//The table was created unquoted, so PostgreSQL folded its name to lower case. raw_table passes the name
+//unquoted as well; the older constructor quotes the table and the columns, so they are given folded.
+void DbLogWriter::copyRows() {
+#if defined(VC_HAVE_STREAM_TO_RAW_TABLE)
+    auto stream = pqxx::stream_to::raw_table(W, tableName, "FRAME_ID, BLOB_ID, X, Y, WIDTH, HEIGHT");
+#elif defined(VC_HAVE_STREAM_TO)
+    std::string foldedName = tableName;
+    std::transform(foldedName.begin(), foldedName.end(), foldedName.begin(), [](char c) {
+        return (char)std::tolower((unsigned char)c);
+    });
+    pqxx::stream_to stream(W, foldedName,
+                           std::vector<std::string>{"frame_id", "blob_id", "x", "y", "width", "height"});
+#endif
+#ifdef VC_HAVE_STREAM_TO
+    for (const auto &row : pending) {
+        stream << std::make_tuple(row.frame, row.id, row.x, row.y, row.width, row.height);
+    }
+    stream.complete();
+#endif
+}
+
+
+//Only integers go into the statement, so building it as text is safe
+void DbLogWriter::insertRows() {
+    statement = "INSERT INTO " + tableName + " (FRAME_ID, BLOB_ID, X, Y, WIDTH, HEIGHT) VALUES ";
+    for (size_t i = 0; i < pending.size(); i++) {
+        const Row &row = pending[i];
+        statement += (i == 0 ? "(" : ", (") + std::to_string(row.frame) + ", " + std::to_string(row.id) + ", " +
+                     std::to_string(row.x) + ", " + std::to_string(row.y) + ", " +
+                     std::to_string(row.width) + ", " + std::to_string(row.height) + ")";
+    }
+    statement += ";";
+    W.exec(statement);
+}
+
+
+DbSink::DbSink(pqxx::connection &C, const std::string &tableName, const DbLogOptions &options)
+        : C(C), tableName(tableName), options(options) {
+}
+
+
+bool DbSink::open() {
+    if (!isValidTableName(tableName)) {
+        throw std::invalid_argument("Invalid table name " + tableName);
+    }
+    W.reset(new pqxx::work(C));
+
+    //The primary key is added after loading, which is much cheaper than maintaining it row by row
+    W->exec("DROP TABLE IF EXISTS " + tableName + ";");
+    W->exec("CREATE TABLE " + tableName + "(" \
+    "FRAME_ID INT NOT NULL, " \
+    "BLOB_ID INT NOT NULL, " \
+    "X INT NOT NULL, " \
+    "Y INT NOT NULL, " \
+    "WIDTH INT NOT NULL, " \
+    "HEIGHT INT NOT NULL);");
+    writer.reset(new DbLogWriter(*W, tableName, options));
+    return true;
+}
+
+
+void DbSink::write(const SinkFrame &frame) {
+    writer->writeFrame(frame);
+    lastFrame = frame.frameNumber;
+}
+
+
+bool DbSink::finish() {
+    if (!writer) {
+        return false;
+    }
+    writer->flush();
+    W->exec("ALTER TABLE " + tableName + " ADD CONSTRAINT " + tableName + "_PK PRIMARY KEY (FRAME_ID, BLOB_ID);");
+    W->commit();
+    rowCount = committedRows + writer->rows();
+    writer.reset();
+    W.reset();
+    return true;
+}
+
+
+bool DbSink::checkpoint(std::string &state) {
+    if (!writer) {
+        return false;
+    }
+    writer->flush();
+    long rows = committedRows + writer->rows();
+    W->commit();
+    committedRows = rows;
+    rowCount = rows;
+    W.reset(new pqxx::work(C));
+    writer.reset(new DbLogWriter(*W, tableName, options));
+    state = std::to_string(lastFrame) + " " + std::to_string(rows);
+    return true;
+}
+
+
+//The table exists from the first checkpoint on; rows of frames after this one belong to a checkpoint
+//that was committed but never recorded
+bool DbSink::resume(const std::string &state) {
+    if (!isValidTableName(tableName)) {
+        throw std::invalid_argument("Invalid table name " + tableName);
+    }
+    std::istringstream ss(state);
+    if (!(ss >> lastFrame >> committedRows)) {
+        return false;
+    }
+    rowCount = committedRows;
+    W.reset(new pqxx::work(C));
+    W->exec("DELETE FROM " + tableName + " WHERE FRAME_ID > " + std::to_string(lastFrame) + ";");
+    writer.reset(new DbLogWriter(*W, tableName, options));
+    return true;
+}
+
+
+bool isValidTableName(const std::string &name) {
+    if (name.empty() || name.size() > 63 || std::isdigit((unsigned char)name[0])) {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return std::isalnum((unsigned char)c) || c == '_';
+    });
+}
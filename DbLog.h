@@ -0,0 +1,87 @@
+#ifndef DB_LOG_H
+#define DB_LOG_H
+
+#include "TrackSink.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+// pqxx::stream_to (COPY ... FROM STDIN) exists since libpqxx 6.4
+#if defined(PQXX_VERSION_MAJOR) && (PQXX_VERSION_MAJOR > 6 || (PQXX_VERSION_MAJOR == 6 && PQXX_VERSION_MINOR >= 4))
+#define VC_HAVE_STREAM_TO 1
+#endif
+// stream_to::raw_table (7.7) takes the table as SQL text; the older constructor quotes it
+#if defined(PQXX_VERSION_MAJOR) && (PQXX_VERSION_MAJOR > 7 || (PQXX_VERSION_MAJOR == 7 && PQXX_VERSION_MINOR >= 7))
+#define VC_HAVE_STREAM_TO_RAW_TABLE 1
+#endif
+
+// How rows reach the database.
+struct DbLogOptions {
+    // Frames buffered before their rows are sent in one COPY or INSERT
+    int batchFrames = 100;
+    // COPY through pqxx::stream_to; multi-row INSERTs if false or if libpqxx is too old
+    bool useCopy = true;
+};
+
+// Buffers the rows of a tracking log table and sends them in batches inside transaction W.
+class DbLogWriter {
+public:
+    DbLogWriter(pqxx::transaction_base &W, const std::string &tableName, const DbLogOptions &options);
+
+    // Adds the tracks of one frame; sends the batch once it holds options.batchFrames frames.
+    void writeFrame(const SinkFrame &frame);
+    // Sends whatever is buffered.
+    void flush();
+    long rows() const { return rowCount; }
+
+private:
+    struct Row {
+        int frame;
+        int id;
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    void copyRows();
+    void insertRows();
+
+    pqxx::transaction_base &W;
+    std::string tableName;
+    DbLogOptions options;
+    std::vector<Row> pending;
+    int pendingFrames = 0;
+    long rowCount = 0;
+    std::string statement;
+};
+
+// Tracking log table: recreated by open(), filled through a DbLogWriter and committed by finish(), which
+// also adds the primary key. Without checkpoints everything is one transaction; every checkpoint()
+// commits the rows so far and starts the next one, and resume() deletes the rows of later frames.
+class DbSink : public TrackSink {
+public:
+    DbSink(pqxx::connection &C, const std::string &tableName, const DbLogOptions &options = DbLogOptions());
+    bool open() override;
+    void write(const SinkFrame &frame) override;
+    bool finish() override;
+    std::string name() const override { return tableName; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+private:
+    pqxx::connection &C;
+    std::string tableName;
+    DbLogOptions options;
+    std::unique_ptr<pqxx::work> W;
+    std::unique_ptr<DbLogWriter> writer;
+    int lastFrame = 0;
+    long committedRows = 0;     // rows of earlier transactions
+};
+
+// Table names are put into SQL unquoted (PostgreSQL folds them to lower case, which existing tables
+// rely on), so only [A-Za-z_][A-Za-z0-9_]* names of at most 63 characters are accepted.
+bool isValidTableName(const std::string &name);
+
+#endif    // DB_LOG_H
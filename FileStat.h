@@ -0,0 +1,13 @@
+#ifndef FILE_STAT_H
+#define FILE_STAT_H
+
+#include <cstdint>
+#include <sys/stat.h>
+
+// Modification time in nanoseconds. The caches built from a log (<log>.idx, <log>.tracks) store it
+// to tell when they are stale, so a log rewritten within the same second is noticed.
+inline int64_t modifiedNs(const struct stat &st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+#endif //FILE_STAT_H
@@ -0,0 +1,122 @@
+#include "FrameDiffer.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iostream>
+
+
+FrameDiffer::FrameDiffer(const TrackingParams &params) : params(params), region(params) {
+    structuringElement5x5 = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+}
+
+
+//Reduced grayscale of frame against the previous one
+bool FrameDiffer::gateChanged(const cv::Mat &frame) {
+    int scale = params.motionGateScale;
+    cv::Size reduced(std::max(1, frame.cols / scale), std::max(1, frame.rows / scale));
+    if (frame.channels() == 1) {
+        cv::resize(frame, gateGray[gateCurrent], reduced, 0, 0, cv::INTER_AREA);
+    } else {
+        cv::resize(frame, gateReduced, reduced, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(gateReduced, gateGray[gateCurrent], CV_BGR2GRAY);
+    }
+    const cv::Mat &previous = gateGray[gateCurrent ^ 1];
+    bool changed = true;
+    if (primed && previous.size() == gateGray[gateCurrent].size()) {
+        cv::absdiff(previous, gateGray[gateCurrent], gateDifference);
+        cv::threshold(gateDifference, gateDifference, params.diffThreshold / 2, 255.0, CV_THRESH_BINARY);
+        changed = cv::countNonZero(gateDifference) > 0;
+    }
+    gateCurrent ^= 1;
+    return changed;
+}
+
+
+bool FrameDiffer::apply(const cv::Mat &sourceFrame) {
+    VC_TIME_STAGE(Preprocess);
+    const cv::Mat &frame = region.apply(sourceFrame);
+    if (params.motionGateScale > 1) {
+        quiet = !gateChanged(frame);
+        if (quiet) {
+            //The next frame is differenced against this one; blurring waits until it is. A luma frame may be a
+            //view of the decoder's buffer, so it is copied.
+            if (frame.channels() == 1) {
+                frame.copyTo(imgGray);
+            } else {
+                cv::cvtColor(frame, imgGray, CV_BGR2GRAY);
+            }
+            pendingGray = true;
+            return true;
+        }
+        if (pendingGray) {
+            cv::GaussianBlur(imgGray, imgBlurred[current ^ 1], cv::Size(5, 5), 0);
+            pendingGray = false;
+        }
+    }
+    bool fusedPath = params.fusedPreprocessing && frame.type() == CV_8UC3 && frame.rows >= 5 && frame.cols >= 5 &&
+                     (!primed || imgBlurred[current ^ 1].size() == frame.size());
+    if (fusedPath) {
+        imgBlurred[current].create(frame.rows, frame.cols, CV_8UC1);
+        imgThreshold.create(frame.rows, frame.cols, CV_8UC1);
+        fused.process(frame.ptr(), frame.step, frame.cols, frame.rows,
+                      imgBlurred[current].ptr(), imgBlurred[current].step,
+                      primed ? imgBlurred[current ^ 1].ptr() : nullptr,
+                      imgThreshold.ptr(), imgThreshold.step, params.diffThreshold);
+    } else {
+        cv::GaussianBlur(grayscale(frame, imgGray), imgBlurred[current], cv::Size(5, 5), 0);
+    }
+    if (!primed) {
+        primed = true;
+        current ^= 1;
+        return false;
+    }
+
+    if (!fusedPath) {
+        cv::absdiff(imgBlurred[current ^ 1], imgBlurred[current], imgDifference);
+        cv::threshold(imgDifference, imgThreshold, params.diffThreshold, 255.0, CV_THRESH_BINARY);
+
+        //Two 5x5 dilations equal one dilation with iterations = 2 (OpenCV turns it into a single 9x9 pass).
+        //Ping-pong between two buffers instead of filtering in place.
+        for (unsigned int i = 0; i < 2; i++) {
+            cv::dilate(imgThreshold, imgMorphology, structuringElement5x5, cv::Point(-1, -1), 2);
+            cv::erode(imgMorphology, imgThreshold, structuringElement5x5);
+        }
+    }
+    region.maskOutside(imgThreshold);
+
+    current ^= 1;
+    return true;
+}
+
+
+long validateFusedPreprocessing(cv::VideoCapture &videoCapture, const TrackingParams &params) {
+    TrackingParams fusedParams = params;
+    fusedParams.fusedPreprocessing = true;
+    FrameDiffer differ(fusedParams);
+    cv::Mat prevFrame, curFrame, mismatch;
+    long frames = 0;
+    long mismatches = 0;
+
+    videoCapture.read(prevFrame);
+    videoCapture.read(curFrame);
+    differ.apply(prevFrame);
+    while (!curFrame.empty()) {
+        differ.apply(curFrame);
+        cv::Mat reference = preprocessFrames(prevFrame, curFrame, params);
+        cv::compare(reference, differ.mask(), mismatch, cv::CMP_NE);
+        int pixels = cv::countNonZero(mismatch);
+        frames++;
+        if (pixels > 0) {
+            if (mismatches < 10) {
+                std::cout << "frame " << frames << ": " << pixels << " pixels differ" << std::endl;
+            }
+            mismatches++;
+        }
+        std::swap(prevFrame, curFrame);
+        if (!readNextFrame(videoCapture, curFrame)) {
+            break;
+        }
+    }
+    std::cout << frames << " frames compared (" << FusedPreprocessor::instructionSet() << "), "
+              << mismatches << " with differing masks" << std::endl;
+    return mismatches;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_DIFFER_H
+#define FRAME_DIFFER_H
+
+#include "MotionDetector.h"
+#include "FusedPreprocess.h"
+#include "ProcessingRegion.h"
+
+// Frame-differencing engine: produces the same motion mask as preprocessFrames, but keeps the blurred
+// grayscale of the previous frame and reuses all of its buffers, so each frame is converted and blurred
+// once and, once the frame size is known, no image buffers are allocated.
+// With params.fusedPreprocessing, 8-bit BGR frames go through FusedPreprocessor instead of the OpenCV calls.
+// Frames are reduced to the ProcessingRegion first, so the mask has the size of the processed image.
+// One-channel frames (luma from a FrameSource) are blurred as they are, without the conversion.
+// With params.motionGateScale, each frame is first compared with the previous one at 1/scale of the size
+// (area averaged, so noise cancels out). If no reduced pixel changed by half the difference threshold, the frame
+// only has its grayscale kept for the next comparison and moved() is false. A vehicle large enough for the blob
+// filters covers many reduced pixels; only a slow one with little contrast to the road can slip through.
+class FrameDiffer : public MotionDetector {
+public:
+    explicit FrameDiffer(const TrackingParams &params = TrackingParams());
+
+    // The first frame only primes the previous-frame buffer
+    bool apply(const cv::Mat &frame) override;
+
+    cv::Mat &mask() override { return imgThreshold; }
+
+    bool moved() const override { return !quiet; }
+
+    void reset() override {
+        primed = false;
+        quiet = false;
+        pendingGray = false;
+    }
+
+private:
+    TrackingParams params;
+    ProcessingRegion region;
+    FusedPreprocessor fused;
+    cv::Mat structuringElement5x5;
+    cv::Mat imgGray;
+    cv::Mat imgBlurred[2];
+    int current = 0;
+    bool primed = false;
+    cv::Mat imgDifference;
+    cv::Mat imgThreshold;
+    cv::Mat imgMorphology;
+
+    bool gateChanged(const cv::Mat &frame);
+
+    cv::Mat gateReduced;
+    cv::Mat gateGray[2];
+    cv::Mat gateDifference;
+    int gateCurrent = 0;
+    bool quiet = false;
+    bool pendingGray = false;   // imgGray holds the last frame, not yet blurred
+};
+
+// Runs the fused kernel and the OpenCV reference (preprocessFrames) side by side over a video and
+// returns the number of frames whose masks differ.
+long validateFusedPreprocessing(cv::VideoCapture &videoCapture, const TrackingParams &params);
+
+#endif    // FRAME_DIFFER_H
@@ -0,0 +1,258 @@
+#include "FrameSource.h"
+#include <algorithm>
+
+#if VC_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+#endif
+
+
+CaptureSource::CaptureSource(cv::VideoCapture &videoCapture) : videoCapture(videoCapture) {
+    start();
+}
+
+
+CaptureSource::CaptureSource(const std::string &path) : ownCapture(path), videoCapture(ownCapture) {
+    start();
+}
+
+
+void CaptureSource::start() {
+    if (videoCapture.isOpened()) {
+        nextFrame = (int)videoCapture.get(CV_CAP_PROP_POS_FRAMES);
+        frames = (int)videoCapture.get(CV_CAP_PROP_FRAME_COUNT);
+        frameRate = videoCapture.get(CV_CAP_PROP_FPS);
+    }
+}
+
+
+bool CaptureSource::read(cv::Mat &frame) {
+    nextFrame++;
+    return videoCapture.read(frame);
+}
+
+
+bool CaptureSource::grab() {
+    nextFrame++;
+    return videoCapture.grab();
+}
+
+
+bool CaptureSource::seek(int frame) {
+    nextFrame = frame;
+    return videoCapture.set(CV_CAP_PROP_POS_FRAMES, frame);
+}
+
+
+#if VC_FFMPEG
+
+namespace {
+
+//libavcodec's frames as they come out of the decoder: read() hands out a view of the Y plane
+class LumaSource : public FrameSource {
+public:
+    ~LumaSource() override;
+
+    bool open(const std::string &path, int threads);
+    bool read(cv::Mat &frame) override;
+    bool grab() override;
+    bool seek(int frame) override;
+    bool luma() const override { return true; }
+    double grayScale() const override { return fullRange ? 1.0 : 219.0 / 255.0; }
+    std::string name() const override { return "ffmpeg"; }
+
+private:
+    bool decodeNext();
+    int frameNumber(int64_t timestamp) const;
+
+    AVFormatContext *format = nullptr;
+    AVCodecContext *codec = nullptr;
+    AVPacket *packet = nullptr;
+    AVFrame *decoded = nullptr;
+    int stream = -1;
+    AVRational rate{0, 1};
+    int64_t startTime = 0;
+    bool fullRange = false;
+    bool held = false;      //seek() decoded the frame the next read() returns
+};
+
+
+LumaSource::~LumaSource() {
+    av_frame_free(&decoded);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec);
+    avformat_close_input(&format);
+}
+
+
+bool LumaSource::open(const std::string &path, int threads) {
+    if (avformat_open_input(&format, path.c_str(), nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(format, nullptr) < 0) {
+        return false;
+    }
+    stream = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream < 0) {
+        return false;
+    }
+    AVStream *video = format->streams[stream];
+    const AVCodec *decoder = avcodec_find_decoder(video->codecpar->codec_id);
+    if (!decoder) {
+        return false;
+    }
+    codec = avcodec_alloc_context3(decoder);
+    if (!codec || avcodec_parameters_to_context(codec, video->codecpar) < 0) {
+        return false;
+    }
+    codec->thread_count = std::max(0, threads);
+    codec->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    if (avcodec_open2(codec, decoder, nullptr) < 0) {
+        return false;
+    }
+
+    //The first plane is the luma, one byte per pixel, only for planar YUV (or semi-planar, like NV12) and gray
+    const AVPixFmtDescriptor *pixels = av_pix_fmt_desc_get(codec->pix_fmt);
+    if (!pixels || (pixels->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                                     AV_PIX_FMT_FLAG_HWACCEL)) ||
+        pixels->comp[0].plane != 0 || pixels->comp[0].step != 1 || pixels->comp[0].depth != 8) {
+        return false;
+    }
+    fullRange = codec->color_range == AVCOL_RANGE_JPEG || codec->pix_fmt == AV_PIX_FMT_YUVJ420P ||
+                codec->pix_fmt == AV_PIX_FMT_YUVJ422P || codec->pix_fmt == AV_PIX_FMT_YUVJ444P ||
+                codec->pix_fmt == AV_PIX_FMT_GRAY8;
+
+    rate = video->avg_frame_rate.num > 0 ? video->avg_frame_rate : video->r_frame_rate;
+    if (rate.num <= 0 || rate.den <= 0) {
+        return false;
+    }
+    startTime = video->start_time != AV_NOPTS_VALUE ? video->start_time : 0;
+    frameRate = av_q2d(rate);
+    if (video->nb_frames > 0) {
+        frames = (int)video->nb_frames;
+    } else if (format->duration > 0) {
+        frames = (int)(format->duration * frameRate / AV_TIME_BASE);
+    }
+    packet = av_packet_alloc();
+    decoded = av_frame_alloc();
+    return packet && decoded;
+}
+
+
+//Next frame into decoded, feeding the decoder packets of the video stream until it has one
+bool LumaSource::decodeNext() {
+    while (true) {
+        int result = avcodec_receive_frame(codec, decoded);
+        if (result == 0) {
+            return true;
+        }
+        if (result != AVERROR(EAGAIN)) {
+            return false;
+        }
+        while (true) {
+            if (av_read_frame(format, packet) < 0) {
+                //End of file: drain the frames still in the decoder
+                avcodec_send_packet(codec, nullptr);
+                break;
+            }
+            bool ours = packet->stream_index == stream;
+            if (ours) {
+                result = avcodec_send_packet(codec, packet);
+            }
+            av_packet_unref(packet);
+            if (ours) {
+                if (result < 0 && result != AVERROR(EAGAIN)) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+int LumaSource::frameNumber(int64_t timestamp) const {
+    return (int)av_rescale_q(timestamp - startTime, format->streams[stream]->time_base, av_inv_q(rate));
+}
+
+
+bool LumaSource::read(cv::Mat &frame) {
+    if (!held && !decodeNext()) {
+        return false;
+    }
+    held = false;
+    nextFrame++;
+    if (decoded->linesize[0] < 0) {
+        return false;
+    }
+    frame = cv::Mat(decoded->height, decoded->width, CV_8UC1, decoded->data[0], (size_t)decoded->linesize[0]);
+    return true;
+}
+
+
+bool LumaSource::grab() {
+    if (!held && !decodeNext()) {
+        return false;
+    }
+    held = false;
+    nextFrame++;
+    return true;
+}
+
+
+bool LumaSource::seek(int frame) {
+    AVStream *video = format->streams[stream];
+    int64_t timestamp = startTime + av_rescale_q(frame, av_inv_q(rate), video->time_base);
+    if (av_seek_frame(format, stream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(codec);
+    held = false;
+    while (decodeNext()) {
+        int64_t decodedTime = decoded->best_effort_timestamp;
+        if (decodedTime == AV_NOPTS_VALUE || frameNumber(decodedTime) >= frame) {
+            held = true;
+            nextFrame = frame;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+#endif
+
+
+bool lumaDecoderAvailable() {
+    return VC_FFMPEG;
+}
+
+
+std::unique_ptr<FrameSource> openLumaSource(const std::string &path, int threads) {
+#if VC_FFMPEG
+    std::unique_ptr<LumaSource> source(new LumaSource());
+    if (source->open(path, threads)) {
+        return source;
+    }
+#else
+    (void)path;
+    (void)threads;
+#endif
+    return nullptr;
+}
+
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string &path, const DecoderOptions &options) {
+    if (options.luma) {
+        if (std::unique_ptr<FrameSource> source = openLumaSource(path, options.threads)) {
+            return source;
+        }
+    }
+    std::unique_ptr<CaptureSource> source(new CaptureSource(path));
+    if (!source->isOpened()) {
+        return nullptr;
+    }
+    return source;
+}
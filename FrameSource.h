@@ -0,0 +1,85 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <memory>
+#include <string>
+
+// Configure with -DVC_FFMPEG=ON to build the luma decoder (needs libavformat, libavcodec and libavutil).
+#ifndef VC_FFMPEG
+#define VC_FFMPEG 0
+#endif
+
+// Frames of a video file for trackVideo. The source keeps the frame count and position itself instead of
+// asking the decoder for them on every frame.
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    // Decodes the next frame. frame is either filled in place (its buffer is reused if it fits) or becomes a
+    // view of the decoder's own buffer, valid until the next read(), grab() or seek(): copy it to keep it.
+    virtual bool read(cv::Mat &frame) = 0;
+    // Moves past the next frame without converting it
+    virtual bool grab() = 0;
+    // The next read() returns frame number frame (counting from 0)
+    virtual bool seek(int frame) = 0;
+    // Frames are 8-bit luma (CV_8UC1) instead of BGR (CV_8UC3)
+    virtual bool luma() const { return false; }
+    // Gray levels of a luma frame per gray level of the same frame converted from BGR: 219 / 255 for the
+    // limited range (16-235) luma of most video, so the difference threshold can be scaled to match
+    virtual double grayScale() const { return 1.0; }
+    // "opencv" or "ffmpeg", for messages
+    virtual std::string name() const = 0;
+
+    // Number of the frame the next read() returns
+    int position() const { return nextFrame; }
+    // As the container reports it, so possibly approximate
+    int frameCount() const { return frames; }
+    double fps() const { return frameRate; }
+
+protected:
+    int nextFrame = 0;
+    int frames = 0;
+    double frameRate = 0.0;
+};
+
+// BGR frames from cv::VideoCapture, decoded in place into the caller's buffer. The original path and the
+// fallback whenever luma decoding is not possible.
+class CaptureSource : public FrameSource {
+public:
+    // Reads from videoCapture (not owned), starting at its current position
+    explicit CaptureSource(cv::VideoCapture &videoCapture);
+    // Opens its own capture of path
+    explicit CaptureSource(const std::string &path);
+
+    bool isOpened() const { return videoCapture.isOpened(); }
+    bool read(cv::Mat &frame) override;
+    bool grab() override;
+    bool seek(int frame) override;
+    std::string name() const override { return "opencv"; }
+
+private:
+    void start();
+
+    cv::VideoCapture ownCapture;
+    cv::VideoCapture &videoCapture;
+};
+
+// How video files are decoded (--decoder).
+struct DecoderOptions {
+    // Decode the luma (Y plane) only with FFmpeg, skipping the conversion to BGR and back to gray
+    bool luma = false;
+    // FFmpeg decoding threads (frame and slice threading), 0 lets FFmpeg choose by the number of cores
+    int threads = 0;
+};
+
+bool lumaDecoderAvailable();
+// FFmpeg luma source for path, or nullptr if this build has no FFmpeg, the video cannot be opened or its pixels
+// are not planar YUV or gray (the Y plane is only the luma there). Seeks decode forward from the key frame before
+// the target, so they are frame-accurate wherever the container has timestamps.
+std::unique_ptr<FrameSource> openLumaSource(const std::string &path, int threads = 0);
+// The luma source if options.luma and possible, a CaptureSource otherwise; nullptr if path cannot be opened.
+std::unique_ptr<FrameSource> openFrameSource(const std::string &path, const DecoderOptions &options);
+
+#endif    // FRAME_SOURCE_H
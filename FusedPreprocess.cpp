@@ -0,0 +1,331 @@
+#include "FusedPreprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__AVX2__)
+
+typedef __m256i Vec;
+const int VEC_U8 = 32;
+const int VEC_U16 = 16;
+#define SHL16(v, n) _mm256_slli_epi16(v, n)
+#define SHR16(v, n) _mm256_srli_epi16(v, n)
+
+inline Vec load(const uint8_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+inline void store(uint8_t *p, Vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+inline Vec maxU8(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+inline Vec minU8(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+inline Vec absDiffU8(Vec a, Vec b) { return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a)); }
+inline Vec splatU8(uint8_t v) { return _mm256_set1_epi8((char)v); }
+inline Vec equalU8(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vec widenU8(const uint8_t *p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)); }
+inline Vec loadU16(const uint16_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+inline void storeU16(uint16_t *p, Vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+inline Vec add16(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+inline Vec splatU16(uint16_t v) { return _mm256_set1_epi16((short)v); }
+inline void storeNarrowU16(uint8_t *p, Vec v) {
+    _mm_storeu_si128((__m128i *)p, _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+#elif defined(__SSE2__)
+
+typedef __m128i Vec;
+const int VEC_U8 = 16;
+const int VEC_U16 = 8;
+#define SHL16(v, n) _mm_slli_epi16(v, n)
+#define SHR16(v, n) _mm_srli_epi16(v, n)
+
+inline Vec load(const uint8_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+inline void store(uint8_t *p, Vec v) { _mm_storeu_si128((__m128i *)p, v); }
+inline Vec maxU8(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+inline Vec minU8(Vec a, Vec b) { return _mm_min_epu8(a, b); }
+inline Vec absDiffU8(Vec a, Vec b) { return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); }
+inline Vec splatU8(uint8_t v) { return _mm_set1_epi8((char)v); }
+inline Vec equalU8(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+inline Vec widenU8(const uint8_t *p) { return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()); }
+inline Vec loadU16(const uint16_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+inline void storeU16(uint16_t *p, Vec v) { _mm_storeu_si128((__m128i *)p, v); }
+inline Vec add16(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+inline Vec splatU16(uint16_t v) { return _mm_set1_epi16((short)v); }
+inline void storeNarrowU16(uint8_t *p, Vec v) { _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(v, v)); }
+
+#else
+
+const int VEC_U8 = 0;
+const int VEC_U16 = 0;
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#define VC_FUSED_SIMD 1
+#endif
+
+
+//Fixed-point BT.601 luma exactly as OpenCV 3 computes CV_BGR2GRAY for 8-bit images
+const int B2Y = 1868;
+const int G2Y = 9617;
+const int R2Y = 4899;
+const int YUV_SHIFT = 14;
+
+void bgrRowToGray(const uint8_t *bgr, uint8_t *gray, int width) {
+    for (int x = 0; x < width; x++, bgr += 3) {
+        gray[x] = (uint8_t)((bgr[0] * B2Y + bgr[1] * G2Y + bgr[2] * R2Y + (1 << (YUV_SHIFT - 1))) >> YUV_SHIFT);
+    }
+}
+
+
+//[1 4 6 4 1] over a row padded by two reflected pixels on each side; result is 16x the blurred value
+void blurRowHorizontal(const uint8_t *p, uint16_t *dst, int width) {
+    int x = 0;
+#ifdef VC_FUSED_SIMD
+    for (; x + VEC_U16 <= width; x += VEC_U16) {
+        Vec a0 = widenU8(p + x), a1 = widenU8(p + x + 1), a2 = widenU8(p + x + 2);
+        Vec a3 = widenU8(p + x + 3), a4 = widenU8(p + x + 4);
+        Vec sum = add16(add16(a0, a4), SHL16(add16(a1, a3), 2));
+        sum = add16(sum, add16(SHL16(a2, 2), SHL16(a2, 1)));
+        storeU16(dst + x, sum);
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = (uint16_t)(p[x] + 4 * p[x + 1] + 6 * p[x + 2] + 4 * p[x + 3] + p[x + 4]);
+    }
+}
+
+
+//Vertical [1 4 6 4 1] and the (sum + 128) >> 8 rounding of OpenCV's bit-exact 8-bit blur; fits in 16 bits
+void blurRowsVertical(const uint16_t *r0, const uint16_t *r1, const uint16_t *r2, const uint16_t *r3,
+                      const uint16_t *r4, uint8_t *dst, int width) {
+    int x = 0;
+#ifdef VC_FUSED_SIMD
+    Vec half = splatU16(128);
+    for (; x + VEC_U16 <= width; x += VEC_U16) {
+        Vec a2 = loadU16(r2 + x);
+        Vec sum = add16(add16(loadU16(r0 + x), loadU16(r4 + x)), SHL16(add16(loadU16(r1 + x), loadU16(r3 + x)), 2));
+        sum = add16(add16(sum, half), add16(SHL16(a2, 2), SHL16(a2, 1)));
+        storeNarrowU16(dst + x, SHR16(sum, 8));
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = (uint8_t)((r0[x] + 4 * r1[x] + 6 * r2[x] + 4 * r3[x] + r4[x] + 128) >> 8);
+    }
+}
+
+
+//|a - b| > t ? 255 : 0 for 0 <= t < 255
+void diffThresholdRow(const uint8_t *a, const uint8_t *b, uint8_t *dst, int width, int t) {
+    int x = 0;
+#ifdef VC_FUSED_SIMD
+    Vec limit = splatU8((uint8_t)(t + 1));
+    for (; x + VEC_U8 <= width; x += VEC_U8) {
+        Vec diff = absDiffU8(load(a + x), load(b + x));
+        store(dst + x, equalU8(maxU8(diff, limit), diff));
+    }
+#endif
+    for (; x < width; x++) {
+        int diff = a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+        dst[x] = diff > t ? 255 : 0;
+    }
+}
+
+
+//Max or min over 2 * radius + 1 neighbours of a row padded by radius neutral pixels on each side
+void rankRowHorizontal(const uint8_t *p, uint8_t *dst, int width, int radius, bool isMax) {
+    int x = 0;
+#ifdef VC_FUSED_SIMD
+    for (; x + VEC_U8 <= width; x += VEC_U8) {
+        Vec acc = load(p + x);
+        for (int k = 1; k <= 2 * radius; k++) {
+            acc = isMax ? maxU8(acc, load(p + x + k)) : minU8(acc, load(p + x + k));
+        }
+        store(dst + x, acc);
+    }
+#endif
+    for (; x < width; x++) {
+        uint8_t acc = p[x];
+        for (int k = 1; k <= 2 * radius; k++) {
+            acc = isMax ? std::max(acc, p[x + k]) : std::min(acc, p[x + k]);
+        }
+        dst[x] = acc;
+    }
+}
+
+
+void rankRowsVertical(const uint8_t *const *rows, int count, uint8_t *dst, int width, bool isMax) {
+    int x = 0;
+#ifdef VC_FUSED_SIMD
+    for (; x + VEC_U8 <= width; x += VEC_U8) {
+        Vec acc = load(rows[0] + x);
+        for (int k = 1; k < count; k++) {
+            acc = isMax ? maxU8(acc, load(rows[k] + x)) : minU8(acc, load(rows[k] + x));
+        }
+        store(dst + x, acc);
+    }
+#endif
+    for (; x < width; x++) {
+        uint8_t acc = rows[0][x];
+        for (int k = 1; k < count; k++) {
+            acc = isMax ? std::max(acc, rows[k][x]) : std::min(acc, rows[k][x]);
+        }
+        dst[x] = acc;
+    }
+}
+
+
+int reflect101(int i, int size) {
+    if (i < 0) {
+        return -i;
+    }
+    if (i >= size) {
+        return 2 * (size - 1) - i;
+    }
+    return i;
+}
+
+}
+
+
+const char *FusedPreprocessor::instructionSet() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+
+void FusedPreprocessor::process(const uint8_t *bgr, size_t bgrStep, int width, int height,
+                                uint8_t *blurredCur, size_t blurredStep, const uint8_t *blurredPrev,
+                                uint8_t *mask, size_t maskStep, double threshold) {
+    this->width = width;
+    this->height = height;
+    this->blurredCur = blurredCur;
+    this->blurredStep = blurredStep;
+    this->blurredPrev = blurredPrev;
+    //8-bit THRESH_BINARY compares against floor(threshold)
+    thresholdValue = (int)std::floor(threshold);
+    blurRowsIn = 0;
+    blurRowsOut = 0;
+    grayRow.resize(width + 4);
+    blurRing.resize(5 * (size_t)width);
+    binaryRow.resize(width);
+
+    if (blurredPrev) {
+        //dilate twice (one 9x9 pass), erode, dilate twice, erode
+        morphology[0].reset(4, true, width, height);
+        morphology[1].reset(2, false, width, height);
+        morphology[2].reset(4, true, width, height);
+        morphology[3].reset(2, false, width, height);
+        for (int i = 0; i < 3; i++) {
+            morphology[i].next = &morphology[i + 1];
+        }
+        morphology[3].dst = mask;
+        morphology[3].dstStep = maskStep;
+    }
+
+    for (int y = 0; y < height; y++) {
+        uint8_t *gray = grayRow.data();
+        bgrRowToGray(bgr + y * bgrStep, gray + 2, width);
+        gray[0] = gray[4];
+        gray[1] = gray[3];
+        gray[width + 2] = gray[width];
+        gray[width + 3] = gray[width - 1];
+        blurRowHorizontal(gray, blurRing.data() + (size_t)(y % 5) * width, width);
+        blurRowsIn++;
+        while (blurRowsOut + 2 < blurRowsIn) {
+            emitBlurredRow();
+        }
+    }
+    while (blurRowsOut < height) {
+        emitBlurredRow();
+    }
+    if (blurredPrev) {
+        morphology[0].finish();
+    }
+}
+
+
+void FusedPreprocessor::emitBlurredRow() {
+    int y = blurRowsOut++;
+    const uint16_t *rows[5];
+    for (int k = 0; k < 5; k++) {
+        rows[k] = blurRing.data() + (size_t)(reflect101(y + k - 2, height) % 5) * width;
+    }
+    uint8_t *blurred = blurredCur + y * blurredStep;
+    blurRowsVertical(rows[0], rows[1], rows[2], rows[3], rows[4], blurred, width);
+    if (!blurredPrev) {
+        return;
+    }
+
+    if (thresholdValue < 0) {
+        std::memset(binaryRow.data(), 255, width);
+    } else if (thresholdValue >= 255) {
+        std::memset(binaryRow.data(), 0, width);
+    } else {
+        diffThresholdRow(blurredPrev + y * blurredStep, blurred, binaryRow.data(), width, thresholdValue);
+    }
+    morphology[0].push(binaryRow.data());
+}
+
+
+void FusedPreprocessor::RankStage::reset(int radius, bool isMax, int width, int height) {
+    this->radius = radius;
+    this->isMax = isMax;
+    this->width = width;
+    this->height = height;
+    rowsIn = 0;
+    rowsOut = 0;
+    //Pixels outside the image never win: 0 for dilation, 255 for erosion
+    padded.assign(width + 2 * radius, isMax ? 0 : 255);
+    ring.resize((size_t)(2 * radius + 1) * width);
+    out.resize(width);
+    next = nullptr;
+    dst = nullptr;
+}
+
+
+void FusedPreprocessor::RankStage::push(const uint8_t *row) {
+    int ringRows = 2 * radius + 1;
+    std::memcpy(padded.data() + radius, row, width);
+    rankRowHorizontal(padded.data(), ring.data() + (size_t)(rowsIn % ringRows) * width, width, radius, isMax);
+    rowsIn++;
+    while (rowsOut + radius < rowsIn) {
+        emit();
+    }
+}
+
+
+void FusedPreprocessor::RankStage::finish() {
+    while (rowsOut < height) {
+        emit();
+    }
+    if (next) {
+        next->finish();
+    }
+}
+
+
+void FusedPreprocessor::RankStage::emit() {
+    int ringRows = 2 * radius + 1;
+    int y = rowsOut++;
+    int first = std::max(0, y - radius);
+    int last = std::min(height - 1, y + radius);
+    const uint8_t *rows[16];
+    for (int i = first; i <= last; i++) {
+        rows[i - first] = ring.data() + (size_t)(i % ringRows) * width;
+    }
+    uint8_t *target = next ? out.data() : dst + y * dstStep;
+    rankRowsVertical(rows, last - first + 1, target, width, isMax);
+    if (next) {
+        next->push(target);
+    }
+}
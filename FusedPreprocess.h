@@ -0,0 +1,63 @@
+#ifndef FUSED_PREPROCESS_H
+#define FUSED_PREPROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fused gray -> 5x5 Gaussian blur -> absdiff -> threshold -> dilate/erode kernel.
+// Rows stream through small per-stage ring buffers (a few rows each), so apart from the blurred frame
+// kept for the next call no intermediate is ever materialized as a full frame. Vectorized with AVX2 when
+// compiled with -mavx2, SSE2 otherwise on x86-64, scalar elsewhere. Output is bit-identical to the
+// OpenCV 3 path in preprocessFrames (fixed-point BGR2GRAY, bit-exact 8-bit GaussianBlur, BORDER_REFLECT_101
+// for the blur, clipped windows for morphology); validateFusedPreprocessing checks that on real videos.
+class FusedPreprocessor {
+public:
+    // Works on raw buffers. blurredCur receives the blurred grayscale of bgr; if blurredPrev is null
+    // only that is computed (priming), otherwise mask receives the final binary motion mask.
+    // Frames must be at least 5x5.
+    void process(const uint8_t *bgr, size_t bgrStep, int width, int height,
+                 uint8_t *blurredCur, size_t blurredStep, const uint8_t *blurredPrev,
+                 uint8_t *mask, size_t maskStep, double threshold);
+
+    static const char *instructionSet();
+
+private:
+    // Separable max (dilate) or min (erode) with a square window, clipped at the image border.
+    struct RankStage {
+        int radius = 0;
+        bool isMax = true;
+        int width = 0;
+        int height = 0;
+        int rowsIn = 0;
+        int rowsOut = 0;
+        std::vector<uint8_t> padded;
+        std::vector<uint8_t> ring;
+        std::vector<uint8_t> out;
+        RankStage *next = nullptr;
+        uint8_t *dst = nullptr;
+        size_t dstStep = 0;
+
+        void reset(int radius, bool isMax, int width, int height);
+        void push(const uint8_t *row);
+        void finish();
+        void emit();
+    };
+
+    void emitBlurredRow();
+
+    int width = 0;
+    int height = 0;
+    int blurRowsIn = 0;
+    int blurRowsOut = 0;
+    int thresholdValue = 0;
+    const uint8_t *blurredPrev = nullptr;
+    uint8_t *blurredCur = nullptr;
+    size_t blurredStep = 0;
+    std::vector<uint8_t> grayRow;
+    std::vector<uint16_t> blurRing;
+    std::vector<uint8_t> binaryRow;
+    RankStage morphology[4];
+};
+
+#endif    // FUSED_PREPROCESS_H
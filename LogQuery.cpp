@@ -0,0 +1,570 @@
+#include "LogQuery.h"
+#include "BatchMode.h"
+#include "BinaryLog.h"
+#include "DbLog.h"
+#include "FileStat.h"
+#include "VideoLog.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+const char TRACK_TABLE_MAGIC[4] = {'V', 'C', 'T', 'S'};
+const uint32_t TRACK_TABLE_VERSION = 1;
+
+// "<log>.tracks": this header, then TrackSummary[trackCount] and TrajectoryPoint[pointCount].
+// The log's size and modification time tell when the cache is stale.
+struct TrackTableHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t logSize;
+    int64_t logModified;    // modifiedNs(), FileStat.h
+    uint64_t trackCount;
+    uint64_t pointCount;
+};
+
+
+
+// Centers of the tracks found in one chunk of a log, by track id
+typedef std::unordered_map<int, std::vector<TrajectoryPoint>> ChunkTracks;
+
+
+//Same center as Blob: the middle of the bounding rect, rounded down
+static TrajectoryPoint centerOf(int frame, long x, long y, long width, long height) {
+    return {frame, (int32_t)((x + x + width) / 2), (int32_t)((y + y + height) / 2)};
+}
+
+
+//Chunks hold consecutive frames and are merged in order, so every track's points stay in frame order
+static void buildTrackTable(std::vector<ChunkTracks> &chunks, TrackTable &table) {
+    std::vector<int> ids;
+    for (const auto &chunk : chunks) {
+        for (const auto &track : chunk) {
+            ids.push_back(track.first);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    table.tracks.clear();
+    table.points.clear();
+    for (int id : ids) {
+        TrackSummary summary = {id, 0, 0, INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN,
+                                (uint32_t)table.points.size(), 0, 0.0f};
+        for (auto &chunk : chunks) {
+            auto found = chunk.find(id);
+            if (found != chunk.end()) {
+                table.points.insert(table.points.end(), found->second.begin(), found->second.end());
+            }
+        }
+        summary.pointCount = (uint32_t)(table.points.size() - summary.firstPoint);
+        for (uint32_t i = summary.firstPoint; i < table.points.size(); i++) {
+            const TrajectoryPoint &point = table.points[i];
+            summary.minX = std::min(summary.minX, point.x);
+            summary.minY = std::min(summary.minY, point.y);
+            summary.maxX = std::max(summary.maxX, point.x);
+            summary.maxY = std::max(summary.maxY, point.y);
+            if (i > summary.firstPoint) {
+                const TrajectoryPoint &previous = table.points[i - 1];
+                summary.pathLength += (float)std::hypot(point.x - previous.x, point.y - previous.y);
+            }
+        }
+        summary.firstFrame = table.points[summary.firstPoint].frame;
+        summary.lastFrame = table.points.back().frame;
+        table.tracks.push_back(summary);
+    }
+}
+
+
+//Next integer on the current line; false at the end of the line (p is left on the '\n')
+static bool parseLong(const char *&p, const char *end, long &value) {
+    while (p < end && (*p == ' ' || *p == '\r')) {
+        p++;
+    }
+    bool negative = p < end && *p == '-';
+    const char *digits = negative ? p + 1 : p;
+    if (digits == end || *digits < '0' || *digits > '9') {
+        return false;
+    }
+    value = 0;
+    for (p = digits; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+    }
+    value = negative ? -value : value;
+    return true;
+}
+
+
+//Lines "<frame> [<id> <x> <y> <width> <height> ]..." in [begin, end)
+static void parseTxtChunk(const char *begin, const char *end, ChunkTracks &tracks) {
+    const char *p = begin;
+    while (p < end) {
+        long frame;
+        if (parseLong(p, end, frame)) {
+            long values[5];
+            while (true) {
+                int count = 0;
+                while (count < 5 && parseLong(p, end, values[count])) {
+                    count++;
+                }
+                if (count < 5) {
+                    break;
+                }
+                tracks[(int)values[0]].push_back(centerOf((int)frame, values[1], values[2], values[3], values[4]));
+            }
+        }
+        const char *newline = (const char *)std::memchr(p, '\n', end - p);
+        p = newline ? newline + 1 : end;
+    }
+}
+
+
+static bool parseTxtLog(const std::string &logPath, int chunks, TrackTable &table) {
+    int fd = ::open(logPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = (size_t)fileStat.st_size;
+    if (size == 0) {
+        ::close(fd);
+        table = TrackTable();
+        return true;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    const char *text = (const char *)data;
+
+    //Chunk boundaries are moved forward to the next line start
+    chunks = std::max(1, std::min(chunks, (int)(size / 65536) + 1));
+    std::vector<size_t> starts(chunks + 1, size);
+    starts[0] = 0;
+    for (int i = 1; i < chunks; i++) {
+        size_t start = std::max(starts[i - 1], size * i / chunks);
+        while (start < size && text[start - 1] != '\n') {
+            start++;
+        }
+        starts[i] = start;
+    }
+
+    std::vector<ChunkTracks> chunkTracks(chunks);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < chunks; i++) {
+        threads.emplace_back(parseTxtChunk, text + starts[i], text + starts[i + 1], std::ref(chunkTracks[i]));
+    }
+    parseTxtChunk(text + starts[0], text + starts[1], chunkTracks[0]);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    munmap(data, size);
+    buildTrackTable(chunkTracks, table);
+    return true;
+}
+
+
+static bool parseBinaryLog(const std::string &logPath, TrackTable &table) {
+    BinaryLogReader reader;
+    if (!reader.open(logPath)) {
+        return false;
+    }
+    std::vector<ChunkTracks> chunkTracks(1);
+    for (int frame = 1; frame <= reader.frames(); frame++) {
+        for (auto record = reader.begin(frame); record != reader.end(frame); ++record) {
+            chunkTracks[0][(int)record->id].push_back(centerOf(frame, record->x, record->y, record->width, record->height));
+        }
+    }
+    buildTrackTable(chunkTracks, table);
+    return true;
+}
+
+
+static bool readTrackTableCache(const std::string &cachePath, const struct stat &logStat, TrackTable &table) {
+    std::ifstream cache(cachePath, std::ios::binary);
+    TrackTableHeader header;
+    if (!cache.read((char *)&header, sizeof(header)) ||
+        std::memcmp(header.magic, TRACK_TABLE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACK_TABLE_VERSION || header.logSize != (uint64_t)logStat.st_size ||
+        header.logModified != modifiedNs(logStat)) {
+        return false;
+    }
+    //Counts that the file cannot hold mean it is damaged, not that there is a lot to read
+    struct stat cacheStat;
+    if (stat(cachePath.c_str(), &cacheStat) != 0 ||
+        (uint64_t)cacheStat.st_size != sizeof(header) + header.trackCount * sizeof(TrackSummary) +
+                                       header.pointCount * sizeof(TrajectoryPoint)) {
+        return false;
+    }
+    table.tracks.resize(header.trackCount);
+    table.points.resize(header.pointCount);
+    if (!cache.read((char *)table.tracks.data(), table.tracks.size() * sizeof(TrackSummary)) ||
+        !cache.read((char *)table.points.data(), table.points.size() * sizeof(TrajectoryPoint))) {
+        return false;
+    }
+    for (const TrackSummary &track : table.tracks) {
+        if (track.firstPoint > header.pointCount || track.pointCount > header.pointCount - track.firstPoint) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//A log in a read-only place is still queried, it is just parsed again next time. The cache is
+//written aside and renamed over, so a concurrent query never reads half of it.
+static void writeTrackTableCache(const std::string &cachePath, const struct stat &logStat, const TrackTable &table) {
+    TrackTableHeader header;
+    std::memcpy(header.magic, TRACK_TABLE_MAGIC, sizeof(header.magic));
+    header.version = TRACK_TABLE_VERSION;
+    header.logSize = (uint64_t)logStat.st_size;
+    header.logModified = modifiedNs(logStat);
+    header.trackCount = table.tracks.size();
+    header.pointCount = table.points.size();
+    std::string temporary = cachePath + ".tmp";
+    {
+        std::ofstream cache(temporary, std::ios::binary | std::ios::trunc);
+        cache.write((const char *)&header, sizeof(header));
+        cache.write((const char *)table.tracks.data(), table.tracks.size() * sizeof(TrackSummary));
+        cache.write((const char *)table.points.data(), table.points.size() * sizeof(TrajectoryPoint));
+        if (!cache) {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+}
+
+
+bool loadTrackTable(const std::string &logPath, int chunks, bool useCache, TrackTable &table, bool &fromCache) {
+    fromCache = false;
+    struct stat logStat;
+    if (stat(logPath.c_str(), &logStat) != 0) {
+        return false;
+    }
+    std::string cachePath = logPath + ".tracks";
+    if (useCache && readTrackTableCache(cachePath, logStat, table)) {
+        fromCache = true;
+        return true;
+    }
+    bool binary = logPath.size() >= BIN_EXT.size() &&
+                  logPath.compare(logPath.size() - BIN_EXT.size(), BIN_EXT.size(), BIN_EXT) == 0;
+    if (!(binary ? parseBinaryLog(logPath, table) : parseTxtLog(logPath, chunks, table))) {
+        return false;
+    }
+    if (useCache) {
+        writeTrackTableCache(cachePath, logStat, table);
+    }
+    return true;
+}
+
+
+void loadTrackTableFromDb(pqxx::connection &C, const std::string &tableName, TrackTable &table) {
+    if (!isValidTableName(tableName)) {
+        throw std::invalid_argument("Invalid table name " + tableName);
+    }
+    pqxx::nontransaction N(C);
+    pqxx::result R = N.exec("SELECT BLOB_ID, FRAME_ID, X, Y, WIDTH, HEIGHT FROM " + tableName +
+                            " ORDER BY BLOB_ID, FRAME_ID;");
+    std::vector<ChunkTracks> chunkTracks(1);
+    for (const auto &row : R) {
+        chunkTracks[0][row[0].as<int>()].push_back(centerOf(row[1].as<int>(), row[2].as<long>(), row[3].as<long>(),
+                                                            row[4].as<long>(), row[5].as<long>()));
+    }
+    buildTrackTable(chunkTracks, table);
+}
+
+
+//Tracks outside the frame range or whose centers never come near the region are skipped by their summary,
+//without looking at their points
+QueryResult queryTrackTable(const TrackTable &table, const QueryOptions &options) {
+    QueryResult result;
+    result.ok = true;
+    cv::Rect regionBounds = options.region.empty() ? cv::Rect() : cv::boundingRect(options.region);
+
+    for (const auto &track : table.tracks) {
+        if (track.lastFrame < options.fromFrame || track.firstFrame > options.toFrame) {
+            continue;
+        }
+        if (!options.region.empty() &&
+            (track.maxX < regionBounds.x || track.minX >= regionBounds.x + regionBounds.width ||
+             track.maxY < regionBounds.y || track.minY >= regionBounds.y + regionBounds.height)) {
+            continue;
+        }
+
+        //A track leaving the region and coming back dwells and moves only in the frames it is inside:
+        //distance and frames are summed over the steps between consecutive points both in the region
+        TrackQueryStats stats = {track.id, 0, 0, 0, -1.0};
+        double distance = 0.0;
+        int movingFrames = 0;
+        const TrajectoryPoint *previous = nullptr;
+        for (uint32_t i = track.firstPoint; i < track.firstPoint + track.pointCount; i++) {
+            const TrajectoryPoint &point = table.points[i];
+            bool inside = point.frame >= options.fromFrame && point.frame <= options.toFrame &&
+                          (options.region.empty() ||
+                           cv::pointPolygonTest(options.region, cv::Point2f((float)point.x, (float)point.y), false) >= 0);
+            if (!inside) {
+                previous = nullptr;
+                continue;
+            }
+            if (stats.dwellFrames == 0) {
+                stats.firstFrame = point.frame;
+            }
+            if (previous) {
+                distance += std::hypot(point.x - previous->x, point.y - previous->y);
+                movingFrames += point.frame - previous->frame;
+            }
+            stats.lastFrame = point.frame;
+            stats.dwellFrames++;
+            previous = &point;
+        }
+        if (stats.dwellFrames == 0) {
+            continue;
+        }
+        if (movingFrames > 0) {
+            stats.speed = distance / movingFrames;
+            result.speedTracks++;
+            result.speedSum += stats.speed;
+            result.maxSpeed = std::max(result.maxSpeed, stats.speed);
+        }
+        result.tracks++;
+        result.dwellFrames += stats.dwellFrames;
+        result.maxDwellFrames = std::max(result.maxDwellFrames, stats.dwellFrames);
+        if (options.perTrack) {
+            result.perTrack.push_back(stats);
+        }
+    }
+    return result;
+}
+
+
+void printQueryUsage(const char *program) {
+    std::cout << "Usage: " << program << " query [options] <log|glob>..." << std::endl
+              << "Counts the tracks of existing logs that pass a region, with their dwell times and speeds." << std::endl
+              << std::endl
+              << "  --region <x,y,x,y,x,y...>    polygon in video pixels a track's center must enter (default: anywhere)" << std::endl
+              << "  --frames <a:b>               only look at log frames a to b (either may be left out)" << std::endl
+              << "  --fps <x>                    report dwell times in seconds and speeds in pixels/s" << std::endl
+              << "  -j, --jobs <n>               threads: one per log, the rest split large logs into chunks" << std::endl
+              << "  --per-track                  also print every matching track as CSV" << std::endl
+              << "  --no-cache                   neither read nor write the <log>.tracks summaries" << std::endl
+              << "  --tables                     inputs are database tables (\"all\" for every table in dbtables.txt)" << std::endl
+              << "  --db <conninfo>              PostgreSQL connection string for --tables" << std::endl
+              << "  -h, --help                   show this message" << std::endl;
+}
+
+
+bool parseQueryOptions(int argc, char **argv, QueryOptions &options, std::string &error) {
+    options.dbConnection = DB_CONNECTION;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.empty() || arg[0] != '-') {
+            options.inputs.push_back(arg);
+            continue;
+        }
+        if (arg == "--per-track") {
+            options.perTrack = true;
+            continue;
+        }
+        if (arg == "--no-cache") {
+            options.useCache = false;
+            continue;
+        }
+        if (arg == "--tables") {
+            options.tables = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "Missing value for " + arg;
+            return false;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--region") {
+                if (!parseRoi(value, options.region)) {
+                    error = "--region needs at least three x,y points";
+                    return false;
+                }
+            } else if (arg == "--frames") {
+                size_t colon = value.find(':');
+                if (colon == std::string::npos) {
+                    error = "--frames needs a:b";
+                    return false;
+                }
+                if (colon > 0) {
+                    options.fromFrame = std::stoi(value.substr(0, colon));
+                }
+                if (colon + 1 < value.size()) {
+                    options.toFrame = std::stoi(value.substr(colon + 1));
+                }
+            } else if (arg == "--fps") {
+                options.fps = std::stod(value);
+            } else if (arg == "-j" || arg == "--jobs") {
+                options.jobs = std::stoi(value);
+                if (options.jobs < 1) {
+                    error = "--jobs must be at least 1";
+                    return false;
+                }
+            } else if (arg == "--db") {
+                options.dbConnection = value;
+            } else {
+                error = "Unknown option " + arg;
+                return false;
+            }
+        } catch (const std::logic_error &) {
+            error = "Invalid value for " + arg + ": " + value;
+            return false;
+        }
+    }
+    if (options.inputs.empty()) {
+        error = "No logs given";
+        return false;
+    }
+    return true;
+}
+
+
+//Every table named in dbtables.txt ("<video> <table>" lines)
+static std::vector<std::string> loggedTables() {
+    std::vector<std::string> tables;
+    std::ifstream dbtables("dbtables.txt");
+    std::string line, video, table;
+    while (std::getline(dbtables, line)) {
+        std::istringstream ss(line);
+        if (ss >> video >> table) {
+            tables.push_back(table);
+        }
+    }
+    return tables;
+}
+
+
+static void printQueryResult(const std::string &name, const QueryResult &result, double fps) {
+    std::string unit = fps > 0 ? " s" : " frames";
+    double timeScale = fps > 0 ? 1.0 / fps : 1.0;
+    double speedScale = fps > 0 ? fps : 1.0;
+    std::cout << name << ": " << result.tracks << " tracks";
+    if (result.tracks > 0) {
+        std::cout << ", dwell avg " << result.dwellFrames * timeScale / result.tracks << unit << ", max "
+                  << result.maxDwellFrames * timeScale << unit;
+    }
+    if (result.speedTracks > 0) {
+        std::cout << ", speed avg " << result.speedSum * speedScale / result.speedTracks << ", max "
+                  << result.maxSpeed * speedScale << (fps > 0 ? " px/s" : " px/frame");
+    }
+    std::cout << (result.fromCache ? " (cached)" : "") << std::endl;
+}
+
+
+int runQuery(int argc, char **argv) {
+    QueryOptions options;
+    std::string error;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printQueryUsage(argv[0]);
+            return 0;
+        }
+    }
+    if (!parseQueryOptions(argc, argv, options, error)) {
+        std::cerr << error << std::endl;
+        printQueryUsage(argv[0]);
+        return 2;
+    }
+
+    bool allMatched = true;
+    std::vector<std::string> inputs;
+    if (!options.tables) {
+        inputs = expandInputs(options.inputs, allMatched);
+    } else if (options.inputs.size() == 1 && options.inputs[0] == "all") {
+        inputs = loggedTables();
+    } else {
+        inputs = options.inputs;
+    }
+
+    //One worker per log; threads left over split the logs into chunks
+    auto start = std::chrono::steady_clock::now();
+    std::vector<QueryResult> results(inputs.size());
+    std::atomic<size_t> next{0};
+    int workers = std::max(1, std::min(options.jobs, (int)inputs.size()));
+    int chunks = std::max(1, options.jobs / workers);
+    auto worker = [&] {
+        std::unique_ptr<pqxx::connection> connection;
+        TrackTable table;
+        for (size_t i = next++; i < inputs.size(); i = next++) {
+            bool fromCache = false;
+            try {
+                if (options.tables) {
+                    if (!connection) {
+                        connection.reset(new pqxx::connection(options.dbConnection));
+                    }
+                    loadTrackTableFromDb(*connection, inputs[i], table);
+                } else if (!loadTrackTable(inputs[i], chunks, options.useCache, table, fromCache)) {
+                    continue;
+                }
+            } catch (const std::exception &e) {
+                std::cerr << inputs[i] << ": " << e.what() << std::endl;
+                continue;
+            }
+            results[i] = queryTrackTable(table, options);
+            results[i].fromCache = fromCache;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workers; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    QueryResult total;
+    bool ok = allMatched;
+    if (options.perTrack) {
+        std::cout << "log,id,first_frame,last_frame,dwell_frames,speed" << std::endl;
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const QueryResult &result = results[i];
+        if (!result.ok) {
+            std::cout << inputs[i] << ": cannot read the log" << std::endl;
+            ok = false;
+            continue;
+        }
+        for (const auto &track : result.perTrack) {
+            std::cout << inputs[i] << "," << track.id << "," << track.firstFrame << "," << track.lastFrame << ","
+                      << track.dwellFrames << "," << track.speed << std::endl;
+        }
+        printQueryResult(inputs[i], result, options.fps);
+        total.tracks += result.tracks;
+        total.dwellFrames += result.dwellFrames;
+        total.maxDwellFrames = std::max(total.maxDwellFrames, result.maxDwellFrames);
+        total.speedTracks += result.speedTracks;
+        total.speedSum += result.speedSum;
+        total.maxSpeed = std::max(total.maxSpeed, result.maxSpeed);
+    }
+    printQueryResult("total", total, options.fps);
+    std::cout << inputs.size() << " logs in " << seconds << " s" << std::endl;
+    return ok ? 0 : 1;
+}
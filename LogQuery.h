@@ -0,0 +1,90 @@
+#ifndef LOG_QUERY_H
+#define LOG_QUERY_H
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <pqxx/pqxx>
+
+// Center of a track in one logged frame.
+struct TrajectoryPoint {
+    int32_t frame;
+    int32_t x;
+    int32_t y;
+};
+
+// One track (BLOB_ID) of a log; its centers are points[firstPoint, firstPoint + pointCount) in frame order.
+struct TrackSummary {
+    int32_t id;
+    int32_t firstFrame;
+    int32_t lastFrame;
+    int32_t minX;           // bounds of its centers
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+    uint32_t firstPoint;
+    uint32_t pointCount;
+    float pathLength;       // pixels travelled by its center
+};
+
+static_assert(sizeof(TrajectoryPoint) == 12, "TrajectoryPoint must have no padding");
+static_assert(sizeof(TrackSummary) == 40, "TrackSummary must have no padding");
+
+// The trajectories of one log, rebuilt from its per-frame rows. For files it is cached next to the log as
+// "<log>.tracks" (a header, then both arrays as they are in memory) and rebuilt whenever the log changes.
+struct TrackTable {
+    std::vector<TrackSummary> tracks;       // by id
+    std::vector<TrajectoryPoint> points;
+};
+
+// TXT or vclog log. Without a valid cache the log is parsed by `chunks` threads and the cache is written;
+// fromCache tells which happened. False if the log cannot be read.
+bool loadTrackTable(const std::string &logPath, int chunks, bool useCache, TrackTable &table, bool &fromCache);
+// Database log table (see dbtables.txt); grouping by track is left to the server.
+void loadTrackTableFromDb(pqxx::connection &C, const std::string &tableName, TrackTable &table);
+
+// Which tracks a query looks at. A track matches if one of its centers lies in the region during the frames.
+struct QueryOptions {
+    std::vector<std::string> inputs;        // logs or globs; table names (or "all") with tables
+    bool tables = false;
+    std::vector<cv::Point> region;          // polygon in video pixels, empty for the whole frame
+    int fromFrame = 1;
+    int toFrame = INT_MAX;
+    double fps = 0.0;                       // converts frames to seconds; 0 reports frames
+    int jobs = 1;
+    bool perTrack = false;
+    bool useCache = true;
+    std::string dbConnection;
+};
+
+struct TrackQueryStats {
+    int id;
+    int firstFrame;         // first and last frame in the region
+    int lastFrame;
+    int dwellFrames;        // frames seen in the region
+    double speed;           // pixels per frame in the region, -1 without two consecutive points in the region
+};
+
+struct QueryResult {
+    bool ok = false;
+    bool fromCache = false;
+    long tracks = 0;
+    long dwellFrames = 0;
+    int maxDwellFrames = 0;
+    long speedTracks = 0;   // tracks with a speed
+    double speedSum = 0.0;
+    double maxSpeed = 0.0;
+    std::vector<TrackQueryStats> perTrack;
+};
+
+QueryResult queryTrackTable(const TrackTable &table, const QueryOptions &options);
+
+// "VehicleCounter_V2 query [options] <log|glob>...": prints counts, dwell times and speeds per log and in total.
+// argv[1] is "query".
+int runQuery(int argc, char **argv);
+bool parseQueryOptions(int argc, char **argv, QueryOptions &options, std::string &error);
+void printQueryUsage(const char *program);
+
+#endif    // LOG_QUERY_H
@@ -0,0 +1,290 @@
+#include "MarkupPlayer.h"
+#include "DbLog.h"
+#include "FileStat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+const cv::Scalar RED = cv::Scalar(0.0, 0.0, 255.0);
+const cv::Scalar GREEN = cv::Scalar(0.0, 200.0, 0.0);
+
+const int ESC_KEY = 27;
+const int SPACE_KEY = 32;
+
+// Frames shown per step in fast-forward
+const int FAST_FORWARD_STEP = 4;
+// Moving ahead by up to this many frames decodes through them instead of seeking the video
+const int MAX_GRAB_AHEAD = 32;
+
+const char TXT_INDEX_MAGIC[4] = {'V', 'C', 'I', 'X'};
+const uint32_t TXT_INDEX_VERSION = 1;
+
+// "<log>.idx": this header, then one uint64_t byte offset per log line. The log's size and
+// modification time tell when the index is stale.
+struct TxtLogIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t logSize;
+    int64_t logModified;    // modifiedNs(), FileStat.h
+    uint64_t frames;
+};
+
+
+
+bool loadTxtLogIndex(const std::string &logPath, std::vector<uint64_t> &offsets) {
+    struct stat logStat;
+    if (stat(logPath.c_str(), &logStat) != 0) {
+        return false;
+    }
+    std::string indexPath = logPath + ".idx";
+    TxtLogIndexHeader header;
+
+    std::ifstream index(indexPath, std::ios::binary);
+    if (index.read((char *)&header, sizeof(header)) &&
+        std::memcmp(header.magic, TXT_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == TXT_INDEX_VERSION && header.logSize == (uint64_t)logStat.st_size &&
+        header.logModified == modifiedNs(logStat)) {
+        offsets.resize(header.frames);
+        if (index.read((char *)offsets.data(), offsets.size() * sizeof(uint64_t))) {
+            return true;
+        }
+    }
+    index.close();
+
+    std::ifstream log(logPath, std::ios::binary);
+    if (!log.is_open()) {
+        return false;
+    }
+    offsets.clear();
+    std::string line;
+    uint64_t offset = 0;
+    while (std::getline(log, line)) {
+        offsets.push_back(offset);
+        offset += line.size() + 1;
+    }
+
+    //A log in a read-only place still plays, the index is just rebuilt next time
+    std::memcpy(header.magic, TXT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = TXT_INDEX_VERSION;
+    header.logSize = (uint64_t)logStat.st_size;
+    header.logModified = modifiedNs(logStat);
+    header.frames = offsets.size();
+    std::ofstream out(indexPath, std::ios::binary | std::ios::trunc);
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+    return true;
+}
+
+
+bool TxtMarkupSource::open(const std::string &logPath) {
+    log.open(logPath, std::ios::binary);
+    nextFrame = 1;
+    return log.is_open() && loadTxtLogIndex(logPath, offsets);
+}
+
+
+void TxtMarkupSource::load(int frame, std::vector<MarkupBox> &boxes) {
+    boxes.clear();
+    if (frame != nextFrame) {
+        log.clear();
+        log.seekg(offsets[frame - 1]);
+    }
+    nextFrame = frame + 1;
+    if (!std::getline(log, line)) {
+        return;
+    }
+
+    const char *p = line.c_str();
+    char *end;
+    std::strtol(p, &end, 10);
+    p = end;
+    while (true) {
+        long values[5];
+        int count = 0;
+        for (; count < 5; count++) {
+            values[count] = std::strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            p = end;
+        }
+        if (count < 5) {
+            return;
+        }
+        boxes.push_back({(int)values[0], cv::Rect((int)values[1], (int)values[2], (int)values[3], (int)values[4])});
+    }
+}
+
+
+void BinaryMarkupSource::load(int frame, std::vector<MarkupBox> &boxes) {
+    boxes.clear();
+    for (auto record = reader.begin(frame); record != reader.end(frame); ++record) {
+        boxes.push_back({(int)record->id, cv::Rect(record->x, record->y, record->width, record->height)});
+    }
+}
+
+
+DbMarkupSource::DbMarkupSource(const std::string &connection, const std::string &tableName)
+        : C(connection), tableName(tableName) {
+    if (!isValidTableName(tableName)) {
+        throw std::invalid_argument("Invalid table name " + tableName);
+    }
+    std::cout << "Connected to " << C.dbname() << std::endl;
+    pqxx::nontransaction N(C);
+    pqxx::result R = N.exec("SELECT max(FRAME_ID) FROM " + tableName + ";");
+    if (!R.empty() && !R[0][0].is_null()) {
+        lastFrame = std::stoi(R[0][0].c_str());
+    }
+}
+
+
+void DbMarkupSource::load(int frame, std::vector<MarkupBox> &boxes) {
+    boxes.clear();
+    pqxx::nontransaction N(C);
+    pqxx::result R = N.exec("SELECT BLOB_ID, X, Y, WIDTH, HEIGHT FROM " + tableName +
+                            " WHERE FRAME_ID = " + std::to_string(frame) + ";");
+    for (const auto &row : R) {
+        boxes.push_back({std::stoi(row[0].c_str()),
+                         cv::Rect(std::stoi(row[1].c_str()), std::stoi(row[2].c_str()),
+                                  std::stoi(row[3].c_str()), std::stoi(row[4].c_str()))});
+    }
+}
+
+
+MarkupPlayer::MarkupPlayer(cv::VideoCapture &videoCapture, MarkupSource &markup)
+        : videoCapture(videoCapture), markup(markup) {
+    fps = videoCapture.get(CV_CAP_PROP_FPS);
+    videoCapture.set(CV_CAP_PROP_POS_FRAMES, 0);
+    if (videoCapture.read(frame)) {
+        fontScale = (frame.rows * frame.cols) / 300000.0;
+        fontThickness = (int)std::round(fontScale * 1.0);
+        videoFrame = 1;
+    }
+}
+
+
+//Log frame k was tracked on the frame pair (k - 1, k), so its boxes belong on video frame k
+bool MarkupPlayer::show(int logFrame) {
+    if (logFrame < videoFrame || logFrame > videoFrame + MAX_GRAB_AHEAD) {
+        videoCapture.set(CV_CAP_PROP_POS_FRAMES, logFrame);
+        videoFrame = logFrame;
+    }
+    for (; videoFrame < logFrame; videoFrame++) {
+        videoCapture.grab();
+    }
+    if (!videoCapture.read(frame)) {
+        return false;
+    }
+    videoFrame++;
+
+    markup.load(logFrame, boxes);
+    for (const auto &box : boxes) {
+        cv::rectangle(frame, box.rect, RED, 2);
+        cv::putText(frame, std::to_string(box.id),
+                    cv::Point(box.rect.x + box.rect.width / 2, box.rect.y + box.rect.height / 2),
+                    CV_FONT_HERSHEY_SIMPLEX, fontScale, GREEN, fontThickness);
+    }
+    cv::imshow("VideoWithMarkup", frame);
+    return true;
+}
+
+
+int MarkupPlayer::frameFromInput(const std::string &input) const {
+    if (input.empty()) {
+        return 0;
+    }
+    if (input.find(':') == std::string::npos) {
+        char *end;
+        long frame = std::strtol(input.c_str(), &end, 10);
+        return *end == '\0' && frame >= 1 && frame <= markup.frames() ? (int)frame : 0;
+    }
+    if (fps <= 0) {
+        return 0;
+    }
+    double seconds = 0.0;
+    std::istringstream ss(input);
+    std::string part;
+    while (std::getline(ss, part, ':')) {
+        char *end;
+        double value = std::strtod(part.c_str(), &end);
+        if (part.empty() || *end != '\0' || value < 0) {
+            return 0;
+        }
+        seconds = seconds * 60.0 + value;
+    }
+    long frame = std::lround(seconds * fps);
+    return frame >= 1 && frame <= markup.frames() ? (int)frame : 0;
+}
+
+
+void MarkupPlayer::play() {
+    bool paused = false;
+    bool fastForward = false;
+    bool quit = false;
+    int current = 1;
+    int shown = 0;
+    int step10s = fps > 0 ? (int)std::lround(fps * 10.0) : 250;
+
+    while (!quit && current <= markup.frames()) {
+        if (current != shown) {
+            if (!show(current)) {
+                break;
+            }
+            shown = current;
+        }
+
+        int key = cv::waitKey(paused ? 0 : (fastForward ? 1 : 15)) & 0xFF;
+        switch (key) {
+            case ESC_KEY:
+                quit = true;
+                continue;
+            case SPACE_KEY:
+                paused = !paused;
+                continue;
+            case 'f':
+                fastForward = !fastForward;
+                break;
+            case ',':
+                current = std::max(1, current - 1);
+                continue;
+            case '.':
+                current = std::min(markup.frames(), current + 1);
+                continue;
+            case '[':
+                current = std::max(1, current - step10s);
+                continue;
+            case ']':
+                current = std::min(markup.frames(), current + step10s);
+                continue;
+            case 'j': {
+                std::string input;
+                std::cout << "Jump to frame (1-" << markup.frames() << ") or time [hh:]mm:ss: " << std::flush;
+                std::cin >> input;
+                int target = frameFromInput(input);
+                if (target > 0) {
+                    current = target;
+                } else {
+                    std::cout << "No such frame." << std::endl;
+                }
+                continue;
+            }
+            default:
+                break;
+        }
+        if (!paused) {
+            current += fastForward ? FAST_FORWARD_STEP : 1;
+        }
+    }
+
+    if (!quit) {
+        std::cout << "end of video\n";
+        cv::waitKey(0);
+    }
+    cv::destroyAllWindows();
+}
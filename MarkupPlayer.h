@@ -0,0 +1,94 @@
+#ifndef MARKUP_PLAYER_H
+#define MARKUP_PLAYER_H
+
+#include "BinaryLog.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <pqxx/pqxx>
+
+// Box of one track in one logged frame.
+struct MarkupBox {
+    int id;
+    cv::Rect rect;
+};
+
+// Logged tracks by frame number (1..frames(), like the log lines), in any order of frames.
+class MarkupSource {
+public:
+    virtual ~MarkupSource() = default;
+    virtual int frames() const = 0;
+    virtual void load(int frame, std::vector<MarkupBox> &boxes) = 0;
+};
+
+// TXT log plus a persisted frame -> byte offset index ("<log>.idx"), built on first use and
+// rebuilt whenever the log changes, so any frame is one seek away.
+class TxtMarkupSource : public MarkupSource {
+public:
+    bool open(const std::string &logPath);
+    int frames() const override { return (int)offsets.size(); }
+    void load(int frame, std::vector<MarkupBox> &boxes) override;
+
+private:
+    std::ifstream log;
+    std::vector<uint64_t> offsets;
+    int nextFrame = 0;      // frame the stream is positioned at, so linear playback needs no seeks
+    std::string line;
+};
+
+class BinaryMarkupSource : public MarkupSource {
+public:
+    bool open(const std::string &logPath) { return reader.open(logPath); }
+    int frames() const override { return reader.frames(); }
+    void load(int frame, std::vector<MarkupBox> &boxes) override;
+
+private:
+    BinaryLogReader reader;
+};
+
+// Frames without tracks have no rows, so the log ends at the last frame with a track.
+class DbMarkupSource : public MarkupSource {
+public:
+    DbMarkupSource(const std::string &connection, const std::string &tableName);
+    int frames() const override { return lastFrame; }
+    void load(int frame, std::vector<MarkupBox> &boxes) override;
+
+private:
+    pqxx::connection C;
+    std::string tableName;
+    int lastFrame = 0;
+};
+
+// Builds "<logPath>.idx" if it is missing or stale and loads it; false if the log cannot be read.
+bool loadTxtLogIndex(const std::string &logPath, std::vector<uint64_t> &offsets);
+
+// Plays a video with the logged boxes drawn over it.
+// Keys: space pause, ESC quit, f fast-forward, , and . one frame back/forward,
+// [ and ] ten seconds back/forward, j jump to a frame number or [hh:]mm:ss typed in the console.
+class MarkupPlayer {
+public:
+    MarkupPlayer(cv::VideoCapture &videoCapture, MarkupSource &markup);
+
+    void play();
+    // Shows log frame (1..markup.frames()), seeking the video if it is not the next one.
+    bool show(int logFrame);
+
+private:
+    // Parses "1234" as a frame and "[hh:]mm:ss[.fff]" as a time; returns 0 if invalid.
+    int frameFromInput(const std::string &input) const;
+
+    cv::VideoCapture &videoCapture;
+    MarkupSource &markup;
+    std::vector<MarkupBox> boxes;
+    cv::Mat frame;
+    int videoFrame = 0;     // index of the next frame videoCapture.read() returns
+    double fps;
+    double fontScale = 1.0;
+    int fontThickness = 1;
+};
+
+#endif    // MARKUP_PLAYER_H
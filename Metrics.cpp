@@ -0,0 +1,165 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static MetricHistogram stageHistograms[(int)MetricStage::Count];
+static MetricHistogram valueHistograms[(int)MetricValue::Count];
+
+static const char *stageNames[(int)MetricStage::Count] = {
+        "decode", "preprocess", "contours", "filter", "match", "sink_write", "sink_wait"};
+static const char *valueNames[(int)MetricValue::Count] = {
+        "contours", "blobs_accepted", "live_tracks", "frame_queue", "mask_queue", "blob_queue", "stream_buffer",
+        "writer_batch"};
+
+
+MetricHistogram &stageHistogram(MetricStage stage) {
+    return stageHistograms[(int)stage];
+}
+
+
+MetricHistogram &valueHistogram(MetricValue value) {
+    return valueHistograms[(int)value];
+}
+
+
+const char *metricName(MetricStage stage) {
+    return stageNames[(int)stage];
+}
+
+
+const char *metricName(MetricValue value) {
+    return valueNames[(int)value];
+}
+
+
+static uint64_t bucketUpperBound(int bucket) {
+    return bucket == 0 ? 0 : (1ull << bucket) - 1;
+}
+
+
+uint64_t MetricHistogram::Snapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(q * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRIC_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+
+MetricHistogram::Snapshot MetricHistogram::snapshot() const {
+    Snapshot snapshot;
+    for (int i = 0; i < METRIC_BUCKETS; i++) {
+        snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count.load(std::memory_order_relaxed);
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    snapshot.max = max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+
+//Cumulative buckets, the same set in every export so rates over time line up; the last bucket is le="+Inf"
+static void writePrometheusHistogram(std::ostream &out, const std::string &name, const std::string &labels,
+                                     const MetricHistogram::Snapshot &snapshot, double unit) {
+    std::string separator = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRIC_BUCKETS - 1; i++) {
+        cumulative += snapshot.buckets[i];
+        out << name << "_bucket{" << labels << separator << "le=\"" << bucketUpperBound(i) * unit << "\"} "
+            << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << snapshot.count << "\n";
+    out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << " " << snapshot.sum * unit << "\n";
+    out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << " " << snapshot.count << "\n";
+}
+
+
+std::string metricsPrometheus() {
+    std::ostringstream out;
+    out << std::setprecision(9);
+    out << "# HELP vc_stage_seconds Time of one call of a tracking stage.\n"
+        << "# TYPE vc_stage_seconds histogram\n";
+    for (int i = 0; i < (int)MetricStage::Count; i++) {
+        writePrometheusHistogram(out, "vc_stage_seconds", std::string("stage=\"") + stageNames[i] + "\"",
+                                 stageHistograms[i].snapshot(), 1e-9);
+    }
+    for (int i = 0; i < (int)MetricValue::Count; i++) {
+        std::string name = std::string("vc_") + valueNames[i];
+        out << "# TYPE " << name << " histogram\n";
+        writePrometheusHistogram(out, name, "", valueHistograms[i].snapshot(), 1.0);
+    }
+    return out.str();
+}
+
+
+std::string metricsJson() {
+    std::ostringstream out;
+    out << std::setprecision(9) << "{\"stages\":{";
+    for (int i = 0; i < (int)MetricStage::Count; i++) {
+        MetricHistogram::Snapshot snapshot = stageHistograms[i].snapshot();
+        out << (i > 0 ? "," : "") << "\"" << stageNames[i] << "\":{\"count\":" << snapshot.count
+            << ",\"total_ms\":" << snapshot.sum * 1e-6
+            << ",\"mean_ms\":" << (snapshot.count > 0 ? snapshot.sum * 1e-6 / snapshot.count : 0.0)
+            << ",\"p50_ms\":" << snapshot.quantile(0.5) * 1e-6 << ",\"p95_ms\":" << snapshot.quantile(0.95) * 1e-6
+            << ",\"p99_ms\":" << snapshot.quantile(0.99) * 1e-6 << ",\"max_ms\":" << snapshot.max * 1e-6 << "}";
+    }
+    out << "},\"values\":{";
+    for (int i = 0; i < (int)MetricValue::Count; i++) {
+        MetricHistogram::Snapshot snapshot = valueHistograms[i].snapshot();
+        out << (i > 0 ? "," : "") << "\"" << valueNames[i] << "\":{\"count\":" << snapshot.count
+            << ",\"mean\":" << (snapshot.count > 0 ? (double)snapshot.sum / snapshot.count : 0.0)
+            << ",\"p50\":" << snapshot.quantile(0.5) << ",\"p95\":" << snapshot.quantile(0.95)
+            << ",\"max\":" << snapshot.max << "}";
+    }
+    out << "}}\n";
+    return out.str();
+}
+
+
+bool writeMetrics(const std::string &path) {
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << (json ? metricsJson() : metricsPrometheus());
+        if (!file) {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+
+MetricsExporter::MetricsExporter(const std::string &path, double intervalSeconds) : path(path) {
+    thread = std::thread([this, intervalSeconds] {
+        auto interval = std::chrono::duration<double>(intervalSeconds > 0 ? intervalSeconds : 10.0);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!changed.wait_for(lock, interval, [this] { return stopping; })) {
+            writeMetrics(this->path);
+        }
+    });
+}
+
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        changed.notify_all();
+    }
+    thread.join();
+    if (!writeMetrics(path)) {
+        std::cerr << "Cannot write " << path << std::endl;
+    }
+}
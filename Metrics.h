@@ -0,0 +1,131 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Hot-path instrumentation: every stage of the tracking loop is timed and a few per-frame counts are
+// recorded, all into fixed log2 histograms updated with relaxed atomics (no locks, no allocations).
+// Configure with -DVC_METRICS=OFF to compile the VC_TIME_STAGE and VC_OBSERVE calls away entirely.
+#ifndef VC_METRICS
+#define VC_METRICS 1
+#endif
+
+enum class MetricStage {
+    Decode,         // reading one frame from the capture
+    Preprocess,     // MotionDetector::apply: grayscale, blur, difference or background model, morphology
+    Contours,       // findContours on the motion mask
+    Filter,         // convex hulls and the blob size/shape filters
+    Match,          // matching detections to tracks, count lines, retiring tracks
+    SinkWrite,      // one frame written to one sink
+    SinkWait,       // tracker blocked because the log writer is a whole batch behind
+    Count
+};
+
+enum class MetricValue {
+    Contours,       // contours found per frame
+    BlobsAccepted,  // detections per frame that passed the filters
+    LiveTracks,     // live tracks after matching
+    FrameQueue,     // --pipeline queue depths, seen by the matching thread
+    MaskQueue,
+    BlobQueue,
+    StreamBuffer,   // --stream frames waiting for the tracker
+    WriterBatch,    // frames handed to the log writer at once
+    Count
+};
+
+const int METRIC_BUCKETS = 40;
+
+// Bucket i counts the values of bit width i: 0 in bucket 0, then [1, 1], [2, 3], [4, 7]... up to 2^39 - 1
+// (9 minutes in nanoseconds); larger values land in the last bucket.
+class MetricHistogram {
+public:
+    void observe(uint64_t value) {
+        int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        buckets[bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t seen = max.load(std::memory_order_relaxed);
+        while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    struct Snapshot {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[METRIC_BUCKETS];
+        // Upper bound of the bucket holding the q-quantile (0 <= q <= 1), capped by max
+        uint64_t quantile(double q) const;
+    };
+
+    // Not taken atomically as a whole, so a concurrent observation may be half counted; fine for export.
+    Snapshot snapshot() const;
+
+private:
+    std::atomic<uint64_t> buckets[METRIC_BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// Process-wide histograms: stage times in nanoseconds, values as they are
+MetricHistogram &stageHistogram(MetricStage stage);
+MetricHistogram &valueHistogram(MetricValue value);
+const char *metricName(MetricStage stage);
+const char *metricName(MetricValue value);
+
+// Adds the time from construction to destruction to a stage.
+class StageTimer {
+public:
+    explicit StageTimer(MetricStage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        stageHistogram(stage).observe((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    MetricStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#if VC_METRICS
+#define VC_METRIC_JOIN2(a, b) a##b
+#define VC_METRIC_JOIN(a, b) VC_METRIC_JOIN2(a, b)
+// Times the rest of the enclosing scope
+#define VC_TIME_STAGE(stage) StageTimer VC_METRIC_JOIN(stageTimer, __LINE__)(MetricStage::stage)
+#define VC_OBSERVE(value, amount) valueHistogram(MetricValue::value).observe((uint64_t)(amount))
+#else
+#define VC_TIME_STAGE(stage) ((void)0)
+#define VC_OBSERVE(value, amount) ((void)0)
+#endif
+
+// Prometheus text exposition format: a vc_stage_seconds histogram labelled by stage and one vc_<value>
+// histogram per value.
+std::string metricsPrometheus();
+// {"stages":{"decode":{"count":..,"mean_ms":..,"p50_ms":..}},"values":{"contours":{"count":..,"mean":..}}}
+std::string metricsJson();
+// JSON if path ends in ".json", Prometheus text otherwise. Written to path + ".tmp" and renamed over path,
+// so readers (e.g. node_exporter's textfile collector) never see half a file.
+bool writeMetrics(const std::string &path);
+
+// Writes the metrics every intervalSeconds on its own thread, and once more when destroyed.
+class MetricsExporter {
+public:
+    MetricsExporter(const std::string &path, double intervalSeconds);
+    ~MetricsExporter();
+
+private:
+    std::string path;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif    // METRICS_H
@@ -0,0 +1,49 @@
+#include "MotionDetector.h"
+#include "FrameDiffer.h"
+#include "BackgroundModel.h"
+
+
+std::unique_ptr<MotionDetector> createMotionDetector(const TrackingParams &params) {
+    switch (params.detector) {
+        case DetectorMode::RunningAverage:
+            return std::unique_ptr<MotionDetector>(new RunningAverageDetector(params));
+        case DetectorMode::Mog2:
+            return std::unique_ptr<MotionDetector>(new Mog2Detector(params));
+        case DetectorMode::FrameDiff:
+            break;
+    }
+    return std::unique_ptr<MotionDetector>(new FrameDiffer(params));
+}
+
+
+const cv::Mat &grayscale(const cv::Mat &frame, cv::Mat &gray) {
+    if (frame.channels() == 1) {
+        return frame;
+    }
+    cv::cvtColor(frame, gray, CV_BGR2GRAY);
+    return gray;
+}
+
+
+const char *detectorName(DetectorMode mode) {
+    switch (mode) {
+        case DetectorMode::RunningAverage:
+            return "average";
+        case DetectorMode::Mog2:
+            return "mog2";
+        case DetectorMode::FrameDiff:
+            break;
+    }
+    return "diff";
+}
+
+
+bool parseDetectorMode(const std::string &name, DetectorMode &mode) {
+    for (DetectorMode candidate : {DetectorMode::FrameDiff, DetectorMode::RunningAverage, DetectorMode::Mog2}) {
+        if (name == detectorName(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
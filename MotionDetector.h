@@ -0,0 +1,40 @@
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include "Tracking.h"
+#include <memory>
+
+// Turns frames into a binary motion mask for extractBlobs. Implemented by FrameDiffer (consecutive frame
+// difference, the original detector) and the background models in BackgroundModel.h; the tracking loops
+// get theirs from createMotionDetector and do not care which one it is.
+class MotionDetector {
+public:
+    virtual ~MotionDetector() = default;
+
+    // Feeds the next frame. Returns false for the first frame after construction or reset(),
+    // which only primes the detector; otherwise mask() holds the new motion mask.
+    virtual bool apply(const cv::Mat &frame) = 0;
+
+    // Valid until the next apply(). extractBlobs may overwrite it (findContours works in place).
+    // Has the size of the ProcessingRegion image, not of the source frame.
+    virtual cv::Mat &mask() = 0;
+
+    // False if apply() found nothing moving without computing the mask (params.motionGateScale); mask() is
+    // then not updated and the frame has no detections.
+    virtual bool moved() const { return true; }
+
+    virtual void reset() = 0;
+};
+
+// frame in grayscale: converted from BGR into gray, or frame itself if it has one channel already (luma from
+// a FrameSource)
+const cv::Mat &grayscale(const cv::Mat &frame, cv::Mat &gray);
+
+// The detector selected by params.detector
+std::unique_ptr<MotionDetector> createMotionDetector(const TrackingParams &params);
+
+// "diff", "average" or "mog2"
+const char *detectorName(DetectorMode mode);
+bool parseDetectorMode(const std::string &name, DetectorMode &mode);
+
+#endif    // MOTION_DETECTOR_H
@@ -0,0 +1,87 @@
+#include "ProcessingRegion.h"
+#include <algorithm>
+#include <cmath>
+
+
+ProcessingRegion::ProcessingRegion(const TrackingParams &params) : params(params) {
+}
+
+
+//The processed size of a ROI box, resized by params.processingScale
+static cv::Size processedSize(const TrackingParams &params, const cv::Size &boxSize) {
+    if (params.processingScale == 1.0) {
+        return boxSize;
+    }
+    return cv::Size(std::max(1, cvRound(boxSize.width * params.processingScale)),
+                    std::max(1, cvRound(boxSize.height * params.processingScale)));
+}
+
+
+const cv::Mat &ProcessingRegion::apply(const cv::Mat &frame) {
+    if (fullFrame()) {
+        return frame;
+    }
+    cv::Rect roiBox = processingBox(params, frame.size());
+    if (roiBox.area() == 0) {
+        CV_Error(cv::Error::StsBadArg, "The region of interest lies outside the frame");
+    }
+    map = processingMap(params, frame.size());
+    cv::Size size = processedSize(params, roiBox.size());
+    //A view, nothing is copied
+    box = frame(roiBox);
+    if (size == roiBox.size()) {
+        return box;
+    }
+    cv::resize(box, resized, size, 0, 0, cv::INTER_AREA);
+    return resized;
+}
+
+
+void ProcessingRegion::maskOutside(cv::Mat &mask) {
+    if (params.roi.size() < 3) {
+        return;
+    }
+    if (polygonMask.size() != mask.size()) {
+        std::vector<cv::Point> polygon;
+        for (const auto &point : params.roi) {
+            polygon.emplace_back(cvRound((point.x - map.origin.x) * map.scaleX),
+                                 cvRound((point.y - map.origin.y) * map.scaleY));
+        }
+        polygonMask = cv::Mat::zeros(mask.size(), CV_8UC1);
+        cv::fillPoly(polygonMask, std::vector<std::vector<cv::Point>>{polygon}, cv::Scalar(255));
+    }
+    cv::bitwise_and(mask, polygonMask, mask);
+}
+
+
+cv::Rect processingBox(const TrackingParams &params, const cv::Size &frameSize) {
+    cv::Rect roiBox(cv::Point(0, 0), frameSize);
+    if (!params.roi.empty()) {
+        roiBox &= cv::boundingRect(params.roi);
+    }
+    return roiBox;
+}
+
+
+ProcessingMap processingMap(const TrackingParams &params, const cv::Size &frameSize) {
+    ProcessingMap map;
+    cv::Rect roiBox = processingBox(params, frameSize);
+    if (roiBox.area() == 0) {
+        return map;
+    }
+    cv::Size size = processedSize(params, roiBox.size());
+    map.origin = roiBox.tl();
+    map.scaleX = (double)size.width / roiBox.width;
+    map.scaleY = (double)size.height / roiBox.height;
+    return map;
+}
+
+
+//Rounded outwards, so the source box always covers the detected one
+cv::Rect processingRectToSource(const cv::Rect &rect, const ProcessingMap &map) {
+    int x0 = (int)std::floor(rect.x / map.scaleX);
+    int y0 = (int)std::floor(rect.y / map.scaleY);
+    int x1 = (int)std::ceil((rect.x + rect.width) / map.scaleX);
+    int y1 = (int)std::ceil((rect.y + rect.height) / map.scaleY);
+    return cv::Rect(map.origin.x + x0, map.origin.y + y0, x1 - x0, y1 - y0);
+}
@@ -0,0 +1,44 @@
+#ifndef PROCESSING_REGION_H
+#define PROCESSING_REGION_H
+
+#include "Tracking.h"
+
+// How a processed image maps to the source frame. The factors are those of the actual resize: cv::resize takes a
+// whole number of pixels, so they differ slightly from params.processingScale and from each other.
+struct ProcessingMap {
+    cv::Point origin;       // where the ROI box starts in the source frame
+    double scaleX = 1.0;    // processed image size / ROI box size
+    double scaleY = 1.0;
+};
+
+// The part of a source frame detection works on: the bounding box of params.roi (or the whole frame),
+// resized by params.processingScale. Inside the box, motion outside the polygon is cleared from the mask.
+// With no ROI and scale 1 frames pass through untouched and the logs are the original ones.
+class ProcessingRegion {
+public:
+    explicit ProcessingRegion(const TrackingParams &params = TrackingParams());
+
+    bool fullFrame() const { return params.roi.empty() && params.processingScale == 1.0; }
+
+    // The processed image of frame: frame itself, a view of the ROI box or the resized box.
+    // Valid until the next call. Throws cv::Exception if the ROI lies outside the frame.
+    const cv::Mat &apply(const cv::Mat &frame);
+    // Clears the pixels of a mask produced from apply() images that lie outside the ROI polygon.
+    void maskOutside(cv::Mat &mask);
+
+private:
+    TrackingParams params;
+    ProcessingMap map;      // of the last apply()
+    cv::Mat box;
+    cv::Mat resized;
+    cv::Mat polygonMask;
+};
+
+// The ROI box (the whole frame without an ROI) within a source frame of frameSize; empty if the ROI lies outside
+cv::Rect processingBox(const TrackingParams &params, const cv::Size &frameSize);
+// The map of the images ProcessingRegion makes of source frames of frameSize
+ProcessingMap processingMap(const TrackingParams &params, const cv::Size &frameSize);
+// Box found in a processed image -> box in the source frame
+cv::Rect processingRectToSource(const cv::Rect &rect, const ProcessingMap &map);
+
+#endif    // PROCESSING_REGION_H
@@ -0,0 +1,430 @@
+#include "SegmentTracking.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+//Boxes of two segments for the same vehicle in the same frame overlap at least this much (IoU)
+const double JOIN_OVERLAP = 0.5;
+
+//Tracked frames of one run, with the rows of all of them in one vector: an 8-hour video at 25 fps has
+//720000 frames, too many for a SinkFrame each
+struct FrameStore {
+    int firstFrame = 1;
+    std::vector<size_t> rowStart{0};
+    std::vector<TrackRow> rows;
+    std::vector<size_t> crossingStart{0};
+    std::vector<LineCrossing> crossings;
+
+    int frames() const { return (int)rowStart.size() - 1; }
+    int lastFrame() const { return firstFrame + frames() - 1; }
+    bool has(int frameNumber) const { return frameNumber >= firstFrame && frameNumber <= lastFrame(); }
+
+    void append(const SinkFrame &frame) {
+        if (frames() == 0) {
+            firstFrame = frame.frameNumber;
+        }
+        rows.insert(rows.end(), frame.tracks.begin(), frame.tracks.end());
+        rowStart.push_back(rows.size());
+        crossings.insert(crossings.end(), frame.crossings.begin(), frame.crossings.end());
+        crossingStart.push_back(crossings.size());
+    }
+
+    void get(int frameNumber, SinkFrame &frame) const {
+        size_t i = (size_t)(frameNumber - firstFrame);
+        frame.frameNumber = frameNumber;
+        frame.tracks.assign(rows.begin() + rowStart[i], rows.begin() + rowStart[i + 1]);
+        frame.crossings.assign(crossings.begin() + crossingStart[i], crossings.begin() + crossingStart[i + 1]);
+    }
+};
+
+struct Segment {
+    int primingFrame = 0;           // tracks.frame at the start: the frame the detector is primed with
+    int firstFrame = 1;             // first frame logged
+    int lastFrame = 0;              // last frame tracked and logged, 0 for the end of the video
+    FrameStore log;                 // every tracked frame after primingFrame
+    std::vector<Blob> finalTracks;  // live tracks after the last frame
+    std::vector<int> stitchedIds;   // by the segment's own track ids, -1 for tracks never logged
+    Clock::time_point finished;
+    std::exception_ptr error;
+};
+
+
+void trackSegment(const std::string &path, const TrackingParams &params, const DecoderOptions &decoder,
+                  Segment &segment) {
+    try {
+        std::unique_ptr<FrameSource> source = openFrameSource(path, decoder);
+        if (!source) {
+            throw std::runtime_error(path + ": cannot open the video");
+        }
+        TrackingParams segmentParams = params;
+        segmentParams.lastFrame = segment.lastFrame;
+        TrackerState tracks;
+        tracks.frame = segment.primingFrame;
+        SinkFrame frame;
+        trackVideo(*source, segmentParams, [&](TrackerState &tracks) {
+            fillSinkFrame(tracks.frame, tracks, frame);
+            segment.log.append(frame);
+        }, tracks);
+        segment.finalTracks = std::move(tracks.blobs);
+    } catch (...) {
+        segment.error = std::current_exception();
+    }
+    segment.finished = Clock::now();
+}
+
+
+double intersectionOverUnion(const TrackRow &a, const TrackRow &b) {
+    cv::Rect first(a.x, a.y, a.width, a.height), second(b.x, b.y, b.width, b.height);
+    double intersection = (first & second).area();
+    return intersection > 0 ? intersection / (first.area() + second.area() - intersection) : 0.0;
+}
+
+
+//Ids in order of the segment's own ids, i.e. of creation, for the logged tracks not joined to earlier ones
+void assignNewIds(Segment &segment, const std::vector<bool> &logged, SegmentStitch &stitch, int &nextId) {
+    for (size_t id = 0; id < segment.stitchedIds.size(); id++) {
+        if (segment.stitchedIds[id] < 0 && logged[id]) {
+            segment.stitchedIds[id] = nextId++;
+            stitch.newTracks++;
+        }
+    }
+}
+
+
+//The previous segment logged the frames this one tracked as its overlap, so a vehicle both of them tracked shows
+//as boxes that coincide frame after frame there. Pairs of tracks are joined by the number of overlap frames their
+//boxes coincide in, most first. A track starting in the first logged frame is one the serial tracker would have
+//matched against the predicted positions of the live tracks, so it is joined like that: to the nearest prediction
+//within half its diagonal among the tracks the previous segment ended with.
+void stitchSegment(const Segment &previous, Segment &segment, SegmentStitch &stitch, int &nextId) {
+    int ids = 0;
+    for (const auto &row : segment.log.rows) {
+        ids = std::max(ids, row.id + 1);
+    }
+    segment.stitchedIds.assign(ids, -1);
+    std::vector<int> firstSeen(ids, 0);
+    std::vector<bool> logged(ids, false);
+    for (int frame = segment.log.firstFrame; frame <= segment.log.lastFrame(); frame++) {
+        size_t i = (size_t)(frame - segment.log.firstFrame);
+        for (size_t row = segment.log.rowStart[i]; row < segment.log.rowStart[i + 1]; row++) {
+            int id = segment.log.rows[row].id;
+            if (firstSeen[id] == 0) {
+                firstSeen[id] = frame;
+            }
+            logged[id] = logged[id] || frame >= segment.firstFrame;
+        }
+    }
+
+    std::map<std::pair<int, int>, int> votes;   //(id in segment, id in previous) -> frames
+    SinkFrame previousFrame, frame;
+    int from = std::max(segment.log.firstFrame, previous.firstFrame);
+    int to = std::min(segment.firstFrame - 1, previous.log.lastFrame());
+    for (int frameNumber = from; frameNumber <= to; frameNumber++) {
+        previous.log.get(frameNumber, previousFrame);
+        segment.log.get(frameNumber, frame);
+        std::vector<bool> previousSeen(previousFrame.tracks.size(), false);
+        for (const auto &row : frame.tracks) {
+            bool seen = false;
+            for (size_t i = 0; i < previousFrame.tracks.size(); i++) {
+                if (intersectionOverUnion(row, previousFrame.tracks[i]) >= JOIN_OVERLAP) {
+                    votes[{row.id, previousFrame.tracks[i].id}]++;
+                    seen = previousSeen[i] = true;
+                }
+            }
+            stitch.overlapDisagreements += !seen;
+        }
+        stitch.overlapDisagreements += std::count(previousSeen.begin(), previousSeen.end(), false);
+    }
+
+    std::vector<std::tuple<int, int, int>> pairs;     //(-frames, id in segment, id in previous)
+    for (const auto &vote : votes) {
+        pairs.emplace_back(-vote.second, vote.first.first, vote.first.second);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<bool> previousJoined(previous.stitchedIds.size(), false);
+    for (const auto &pair : pairs) {
+        int id = std::get<1>(pair), previousId = std::get<2>(pair);
+        if (segment.stitchedIds[id] < 0 && !previousJoined[previousId] && previous.stitchedIds[previousId] >= 0) {
+            segment.stitchedIds[id] = previous.stitchedIds[previousId];
+            previousJoined[previousId] = true;
+            stitch.overlapJoined++;
+        }
+    }
+
+    if (segment.log.has(segment.firstFrame)) {
+        segment.log.get(segment.firstFrame, frame);
+        for (const auto &row : frame.tracks) {
+            if (segment.stitchedIds[row.id] >= 0 || firstSeen[row.id] != segment.firstFrame) {
+                continue;
+            }
+            Blob blob(cv::Rect(row.x, row.y, row.width, row.height));
+            double nearest = blob.dblCurrentDiagonalSize * 0.5;
+            int joined = -1;
+            for (Blob candidate : previous.finalTracks) {
+                int previousId = candidate.intId;
+                if (previousId >= (int)previousJoined.size() || previousJoined[previousId] ||
+                    previous.stitchedIds[previousId] < 0) {
+                    continue;
+                }
+                candidate.predictNextPosition();
+                double distance = distanceBetweenPoints(candidate.predictedNextPosition, blob.centerPositions.back());
+                if (distance < nearest) {
+                    nearest = distance;
+                    joined = previousId;
+                }
+            }
+            if (joined >= 0) {
+                segment.stitchedIds[row.id] = previous.stitchedIds[joined];
+                previousJoined[joined] = true;
+                stitch.predictionJoined++;
+            }
+        }
+    }
+    assignNewIds(segment, logged, stitch, nextId);
+}
+
+
+//Frame by frame against the serial run, as the stitched frames are produced
+class SerialComparison {
+public:
+    SerialComparison(const FrameStore &serial, SegmentComparison &result) : serial(serial), result(result) {}
+
+    void compare(const SinkFrame &stitched, int segment, int segmentStart) {
+        result.frames++;
+        result.stitchedCrossings += stitched.crossings.size();
+        bool differs = true;
+        if (serial.has(stitched.frameNumber)) {
+            serial.get(stitched.frameNumber, serialFrame);
+            result.serialCrossings += serialFrame.crossings.size();
+            differs = boxes(serialFrame) != boxes(stitched);
+            for (const auto &row : serialFrame.tracks) {
+                auto same = std::find_if(stitched.tracks.begin(), stitched.tracks.end(), [&](const TrackRow &other) {
+                    return other.x == row.x && other.y == row.y && other.width == row.width &&
+                           other.height == row.height;
+                });
+                if (same == stitched.tracks.end()) {
+                    continue;
+                }
+                auto known = stitchedIds.find(row.id);
+                if (known == stitchedIds.end()) {
+                    stitchedIds[row.id] = same->id;
+                } else if (known->second != same->id) {
+                    result.idSwitches++;
+                    known->second = same->id;
+                }
+            }
+        }
+        if (differs) {
+            result.differingFrames++;
+            if (segment > 0) {
+                result.settleFrames[segment - 1] = std::max(result.settleFrames[segment - 1],
+                                                            stitched.frameNumber - segmentStart + 1);
+            }
+        }
+    }
+
+    //Serial frames past the last stitched one
+    void finish(int lastFrame) {
+        for (int frameNumber = std::max(lastFrame + 1, serial.firstFrame); frameNumber <= serial.lastFrame();
+             frameNumber++) {
+            serial.get(frameNumber, serialFrame);
+            result.frames++;
+            result.differingFrames++;
+            result.serialCrossings += serialFrame.crossings.size();
+        }
+    }
+
+private:
+    static std::vector<std::tuple<int, int, int, int>> boxes(const SinkFrame &frame) {
+        std::vector<std::tuple<int, int, int, int>> result;
+        for (const auto &row : frame.tracks) {
+            result.emplace_back(row.x, row.y, row.width, row.height);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    const FrameStore &serial;
+    SegmentComparison &result;
+    SinkFrame serialFrame;
+    std::unordered_map<int, int> stitchedIds;   //by serial id, the stitched id of its last box
+};
+
+}
+
+
+int trackVideoSegmented(const std::string &path, const TrackingParams &params, const SegmentOptions &options,
+                        const SinkFrameCallback &onFrame, SegmentReport &report, const DecoderOptions &decoder) {
+    int lastFrame;
+    {
+        std::unique_ptr<FrameSource> source = openFrameSource(path, decoder);
+        if (!source) {
+            return -1;
+        }
+        lastFrame = source->frameCount() - 2;
+    }
+    const int stride = std::max(1, params.frameStride);
+    const int count = std::max(1, std::min(options.segments, lastFrame));
+    report = SegmentReport();
+    report.segments = count;
+    report.overlapFrames = options.overlapFrames;
+
+    Segment serial;
+    if (options.compareSerial) {
+        auto start = Clock::now();
+        trackSegment(path, params, decoder, serial);
+        if (serial.error) {
+            std::rethrow_exception(serial.error);
+        }
+        report.compared = true;
+        report.comparison.serialSeconds = std::chrono::duration<double>(serial.finished - start).count();
+        report.comparison.settleFrames.assign(count - 1, 0);
+    }
+
+    std::vector<Segment> segments(count);
+    for (int k = 0; k < count; k++) {
+        Segment &segment = segments[k];
+        segment.firstFrame = 1 + (int)((long)k * lastFrame / count);
+        segment.lastFrame = k + 1 < count ? (int)((long)(k + 1) * lastFrame / count) : 0;
+        //Primed with a frame the serial run tracks as well, so a stride keeps its phase
+        if (k > 0) {
+            segment.primingFrame = std::max(0, segment.firstFrame - 1 - std::max(0, options.overlapFrames)) /
+                                   stride * stride;
+        }
+    }
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (auto &segment : segments) {
+        threads.emplace_back(trackSegment, std::cref(path), std::cref(params), std::cref(decoder), std::ref(segment));
+    }
+
+    //Segments are stitched and passed on in order while later ones are still being tracked
+    SerialComparison comparison(serial.log, report.comparison);
+    std::unordered_map<int, unsigned long long> countedLines;  //by stitched id, like Blob::countedLines
+    std::exception_ptr error;
+    SinkFrame frame;
+    int nextId = 0;
+    int emitted = 0;
+    bool stopped = false;
+    for (int k = 0; k < count; k++) {
+        threads[k].join();
+        Segment &segment = segments[k];
+        if (segment.error && !error) {
+            error = segment.error;
+        }
+        if (error || stopped) {
+            continue;
+        }
+        SegmentStitch stitch;
+        stitch.frame = segment.firstFrame;
+        if (k == 0) {
+            int ids = 0;
+            for (const auto &row : segment.log.rows) {
+                ids = std::max(ids, row.id + 1);
+            }
+            segment.stitchedIds.assign(ids, -1);
+            assignNewIds(segment, std::vector<bool>(ids, true), stitch, nextId);
+        } else {
+            stitchSegment(segments[k - 1], segment, stitch, nextId);
+            segments[k - 1] = Segment();
+        }
+
+        int end = segment.log.lastFrame();
+        try {
+            for (int frameNumber = segment.firstFrame; frameNumber <= end; frameNumber++) {
+                segment.log.get(frameNumber, frame);
+                for (auto &row : frame.tracks) {
+                    row.id = segment.stitchedIds[row.id];
+                }
+                //Live tracks are in id order in the serial tracker
+                std::sort(frame.tracks.begin(), frame.tracks.end(), [](const TrackRow &a, const TrackRow &b) {
+                    return a.id < b.id;
+                });
+                auto kept = frame.crossings.begin();
+                for (auto crossing : frame.crossings) {
+                    crossing.trackId = segment.stitchedIds[crossing.trackId];
+                    unsigned long long &counted = countedLines[crossing.trackId];
+                    if (counted & (1ULL << crossing.line)) {
+                        stitch.duplicateCrossings++;
+                        continue;
+                    }
+                    counted |= 1ULL << crossing.line;
+                    *kept++ = crossing;
+                }
+                frame.crossings.erase(kept, frame.crossings.end());
+                if (report.compared) {
+                    comparison.compare(frame, k, segment.firstFrame);
+                }
+                onFrame(frame);
+                emitted++;
+            }
+        } catch (...) {
+            error = std::current_exception();
+            continue;
+        }
+        if (k > 0) {
+            report.stitches.push_back(stitch);
+        }
+        //The serial run would have ended here as well
+        if (segment.lastFrame > 0 && end < segment.lastFrame) {
+            report.truncatedAt = std::max(end, segment.firstFrame - 1);
+            stopped = true;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    Clock::time_point finished = start;
+    for (const auto &segment : segments) {
+        finished = std::max(finished, segment.finished);
+    }
+    report.comparison.segmentedSeconds = std::chrono::duration<double>(finished - start).count();
+    if (report.compared) {
+        comparison.finish(report.truncatedAt > 0 ? report.truncatedAt : segments.back().log.lastFrame());
+    }
+    report.frames = emitted;
+    return emitted;
+}
+
+
+std::string SegmentReport::summary() const {
+    std::ostringstream ss;
+    ss << "segments: " << segments << " with " << overlapFrames << " overlap frames, " << frames
+       << " frames logged" << std::endl;
+    if (truncatedAt > 0) {
+        ss << "  a segment ended early, nothing logged after frame " << truncatedAt << std::endl;
+    }
+    for (const auto &stitch : stitches) {
+        ss << "  frame " << stitch.frame << ": " << stitch.overlapJoined << " tracks joined on the overlap, "
+           << stitch.predictionJoined << " by prediction, " << stitch.newTracks << " new; "
+           << stitch.overlapDisagreements << " overlap boxes in one segment only, " << stitch.duplicateCrossings
+           << " repeated crossings dropped" << std::endl;
+    }
+    if (compared) {
+        ss << "  against the serial run: " << comparison.differingFrames << " of " << comparison.frames
+           << " frames differ, " << comparison.idSwitches << " id switches, " << comparison.stitchedCrossings
+           << " crossings (serial " << comparison.serialCrossings << "); " << comparison.segmentedSeconds
+           << " s (serial " << comparison.serialSeconds << " s, "
+           << (comparison.segmentedSeconds > 0 ? comparison.serialSeconds / comparison.segmentedSeconds : 0.0)
+           << "x)" << std::endl;
+        for (size_t i = 0; i < comparison.settleFrames.size() && i < stitches.size(); i++) {
+            if (comparison.settleFrames[i] > 0) {
+                ss << "  frame " << stitches[i].frame << ": last difference from the serial run "
+                   << comparison.settleFrames[i] << " frames in" << std::endl;
+            }
+        }
+    }
+    return ss.str();
+}
@@ -0,0 +1,67 @@
+#ifndef SEGMENT_TRACKING_H
+#define SEGMENT_TRACKING_H
+
+#include "Tracking.h"
+#include "TrackSink.h"
+#include "FrameSource.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// Splitting one video into time segments that are tracked at once (--segments).
+struct SegmentOptions {
+    int segments = 1;
+    // Frames a segment tracks before its first logged frame. They pick up the vehicles already in the picture
+    // and are compared with the end of the previous segment to join their tracks.
+    int overlapFrames = 50;
+    // Also track the video serially first and compare the stitched result with it
+    bool compareSerial = false;
+};
+
+// How the tracks of a segment were joined to those of the segment before it.
+struct SegmentStitch {
+    int frame = 0;                  // first logged frame of the segment
+    int overlapJoined = 0;          // tracks matched to a previous track by their boxes in the overlap
+    int predictionJoined = 0;       // tracks starting at the boundary, matched to a previous track's prediction
+    int newTracks = 0;              // logged tracks of the segment given new ids
+    long overlapDisagreements = 0;  // boxes in the overlap only one of the two segments has
+    int duplicateCrossings = 0;     // crossings dropped, the joined track was already counted on that line
+};
+
+// The stitched result against a serial run of the same video (SegmentOptions::compareSerial).
+struct SegmentComparison {
+    long frames = 0;
+    long differingFrames = 0;       // frames whose boxes differ, ids aside
+    std::vector<int> settleFrames;  // per boundary: frames after it up to the last differing frame of its segment
+    long idSwitches = 0;            // boxes of a serial track logged under another id than its earlier boxes
+    long serialCrossings = 0;
+    long stitchedCrossings = 0;
+    double serialSeconds = 0.0;
+    double segmentedSeconds = 0.0;  // tracking the segments, until the last of them finished
+};
+
+struct SegmentReport {
+    int segments = 0;
+    int overlapFrames = 0;
+    int frames = 0;                 // frames logged
+    int truncatedAt = 0;            // a segment stopped before its end (bad frame): nothing is logged past this
+    std::vector<SegmentStitch> stitches;
+    bool compared = false;
+    SegmentComparison comparison;
+
+    // A few lines for the batch summary
+    std::string summary() const;
+};
+
+typedef std::function<void(const SinkFrame &frame)> SinkFrameCallback;
+
+// Tracks the video at path in options.segments time segments, each on its own thread with its own source
+// (openFrameSource with decoder) seeked to the start of its overlap, so the video must seek frame-accurately.
+// Joins the tracks of neighbouring segments. onFrame gets every frame in order, numbered and filled as logTracks
+// would, with the tracks renamed to stitched ids; a segment's frames follow as soon as it and all before it are done.
+// Returns the number of frames passed to onFrame, or -1 if the video cannot be opened.
+int trackVideoSegmented(const std::string &path, const TrackingParams &params, const SegmentOptions &options,
+                        const SinkFrameCallback &onFrame, SegmentReport &report,
+                        const DecoderOptions &decoder = DecoderOptions());
+
+#endif    // SEGMENT_TRACKING_H
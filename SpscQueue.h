@@ -0,0 +1,82 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+    // Returns false without touching item if the queue is full.
+    bool push(T &&item) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots.size();
+        if (next == headIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[tail] = std::move(item);
+        tailIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots[head]);
+        headIndex.store((head + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Blocking variants: spin briefly, then sleep. They give up and return false once cancelled is set.
+    bool pushWait(T &&item, const std::atomic<bool> &cancelled) {
+        for (int spins = 0; !push(std::move(item)); spins++) {
+            if (cancelled.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            backoff(spins);
+        }
+        return true;
+    }
+
+    bool popWait(T &item, const std::atomic<bool> &cancelled) {
+        for (int spins = 0; !pop(item); spins++) {
+            if (cancelled.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            backoff(spins);
+        }
+        return true;
+    }
+
+    size_t size() const {
+        size_t head = headIndex.load(std::memory_order_acquire);
+        size_t tail = tailIndex.load(std::memory_order_acquire);
+        return (tail + slots.size() - head) % slots.size();
+    }
+
+    size_t capacity() const { return slots.size() - 1; }
+
+private:
+    static void backoff(int spins) {
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+};
+
+#endif    // SPSC_QUEUE_H
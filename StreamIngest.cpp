@@ -0,0 +1,181 @@
+#include "StreamIngest.h"
+#include "MotionDetector.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+static volatile std::sig_atomic_t stopSignal = 0;
+
+static void onStopSignal(int) {
+    stopSignal = 1;
+}
+
+
+void installStreamStopHandlers() {
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+}
+
+
+bool streamStopRequested() {
+    return stopSignal != 0;
+}
+
+
+void printStreamStats(const StreamStats &stats) {
+    std::cout << "stream: " << stats.captured << " captured, " << stats.processed << " tracked, "
+              << stats.dropped << " dropped, " << stats.skipped << " skipped, lag avg "
+              << (stats.processed > 0 ? stats.totalLagMs / stats.processed : 0.0) << " ms, max "
+              << stats.maxLagMs << " ms" << std::endl;
+}
+
+
+int trackStream(cv::VideoCapture &videoCapture, const TrackingParams &params, const StreamOptions &options,
+                const StreamFrameCallback &onFrame, StreamStats &stats) {
+    typedef std::chrono::steady_clock Clock;
+    struct CapturedFrame {
+        cv::Mat frame;
+        StreamFrameInfo info;
+        Clock::time_point captured;
+    };
+
+    std::deque<CapturedFrame> buffer;
+    std::vector<cv::Mat> freeFrames;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool ended = false;
+    std::atomic<bool> stopCapture{false};
+    const size_t bufferFrames = (size_t)std::max(1, options.bufferFrames);
+
+    //Capture never waits for the tracker unless the policy says so, like a camera that keeps sending
+    std::thread capture([&] {
+        double fps = videoCapture.get(CV_CAP_PROP_FPS);
+        bool paced = options.realtime && fps > 0;
+        Clock::time_point start = Clock::now();
+        for (long sequence = 0; !stopCapture && !streamStopRequested(); sequence++) {
+            if (paced) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(sequence / fps)));
+            }
+            CapturedFrame item;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!freeFrames.empty()) {
+                    item.frame = std::move(freeFrames.back());
+                    freeFrames.pop_back();
+                }
+            }
+            {
+                VC_TIME_STAGE(Decode);
+                if (!videoCapture.read(item.frame) || item.frame.empty()) {
+                    break;
+                }
+            }
+            item.captured = Clock::now();
+            item.info.sequence = sequence;
+            item.info.captureTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            stats.captured++;
+            if (buffer.size() >= bufferFrames) {
+                switch (options.dropPolicy) {
+                    case DropPolicy::Block:
+                        changed.wait(lock, [&] { return buffer.size() < bufferFrames || stopCapture; });
+                        break;
+                    case DropPolicy::DropOldest:
+                        freeFrames.push_back(std::move(buffer.front().frame));
+                        buffer.pop_front();
+                        stats.dropped++;
+                        break;
+                    case DropPolicy::Latest:
+                        for (auto &dropped : buffer) {
+                            freeFrames.push_back(std::move(dropped.frame));
+                        }
+                        stats.dropped += buffer.size();
+                        buffer.clear();
+                        break;
+                }
+            }
+            buffer.push_back(std::move(item));
+            changed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        ended = true;
+        changed.notify_all();
+    });
+
+    std::unique_ptr<MotionDetector> detector = createMotionDetector(params);
+    TrackerState tracks;
+    std::vector<Blob> curFrameBlobs;
+    ContourBuffers contourBuffers;
+    int frames = 0;
+    Clock::time_point lastReport = Clock::now();
+    CapturedFrame item;
+
+    while (true) {
+        bool newerWaiting;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!item.frame.empty()) {
+                freeFrames.push_back(std::move(item.frame));
+            }
+            changed.wait(lock, [&] { return !buffer.empty() || ended; });
+            if (buffer.empty()) {
+                break;
+            }
+            VC_OBSERVE(StreamBuffer, buffer.size());
+            item = std::move(buffer.front());
+            buffer.pop_front();
+            newerWaiting = !buffer.empty();
+            changed.notify_all();
+        }
+
+        double ageMs = std::chrono::duration<double, std::milli>(Clock::now() - item.captured).count();
+        if (options.dropPolicy != DropPolicy::Block && newerWaiting && ageMs > options.latencyBudgetMs) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.skipped++;
+            continue;
+        }
+        try {
+            if (!detector->apply(item.frame)) {
+                continue;
+            }
+            curFrameBlobs.clear();
+            if (detector->moved()) {
+                extractBlobs(detector->mask(), item.frame.size(), curFrameBlobs, params, contourBuffers);
+            }
+            matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+        } catch (cv::Exception &e) {
+            std::cout << e.msg << std::endl;
+            break;
+        }
+        onFrame(tracks, item.info);
+        frames++;
+
+        double lagMs = std::chrono::duration<double, std::milli>(Clock::now() - item.captured).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.processed++;
+        stats.totalLagMs += lagMs;
+        stats.maxLagMs = std::max(stats.maxLagMs, lagMs);
+        if (options.reportSeconds > 0 &&
+            std::chrono::duration<double>(Clock::now() - lastReport).count() >= options.reportSeconds) {
+            printStreamStats(stats);
+            lastReport = Clock::now();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopCapture = true;
+        changed.notify_all();
+    }
+    capture.join();
+    return frames;
+}
@@ -0,0 +1,58 @@
+#ifndef STREAM_INGEST_H
+#define STREAM_INGEST_H
+
+#include "Tracking.h"
+#include <cstdint>
+
+// What the capture thread does when the tracker has not taken the buffered frames yet.
+enum class DropPolicy {
+    Block,          // wait for the tracker; nothing is lost, latency grows (files, offline replays)
+    DropOldest,     // discard the oldest buffered frame
+    Latest          // discard everything buffered and keep only the newest frame
+};
+
+// Live sources (RTSP, v4l2, pipes) have no frame count: they are read until EOF or a stop request.
+struct StreamOptions {
+    bool enabled = false;
+    DropPolicy dropPolicy = DropPolicy::DropOldest;
+    // Frames buffered between the capture thread and the tracker
+    int bufferFrames = 8;
+    // Frames older than this when the tracker gets to them are skipped if a newer one is waiting
+    // (not with DropPolicy::Block)
+    double latencyBudgetMs = 500.0;
+    // Read a file at its own frame rate, as a camera would deliver it
+    bool realtime = false;
+    // Seconds between lag reports, 0 for none
+    double reportSeconds = 10.0;
+};
+
+// Counters of a stream run. Lag is the time from capture to the end of tracking of a frame.
+struct StreamStats {
+    long captured = 0;
+    long processed = 0;
+    long dropped = 0;       // discarded by the capture thread because the buffer was full
+    long skipped = 0;       // taken from the buffer but over the latency budget
+    double totalLagMs = 0.0;
+    double maxLagMs = 0.0;
+};
+
+// Per-frame data that only streams have.
+struct StreamFrameInfo {
+    long sequence;              // number of the frame in capture order from 0, counting dropped frames; the
+                                // first one only primes the detector, so logs start at 1 as for files
+    int64_t captureTimeMs;      // wall clock (ms since the epoch) when the frame was read
+};
+
+typedef std::function<void(TrackerState &tracks, const StreamFrameInfo &info)> StreamFrameCallback;
+
+// Tracks a live source: a capture thread reads frames into a bounded buffer while the calling thread
+// tracks them and calls onFrame. Returns the number of frames passed to onFrame.
+int trackStream(cv::VideoCapture &videoCapture, const TrackingParams &params, const StreamOptions &options,
+                const StreamFrameCallback &onFrame, StreamStats &stats);
+void printStreamStats(const StreamStats &stats);
+
+// SIGINT and SIGTERM end running streams cleanly (the buffered frames are still tracked and logged).
+void installStreamStopHandlers();
+bool streamStopRequested();
+
+#endif    // STREAM_INGEST_H
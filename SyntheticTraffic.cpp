@@ -0,0 +1,140 @@
+#include "SyntheticTraffic.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+
+const int TEXTURE_COUNT = 4;
+const int TEXTURE_BLOCK = 10;
+const int BACKGROUND = 60;
+
+
+//splitmix64: well mixed, and the same on every platform
+static uint64_t mix(uint64_t seed, uint64_t value) {
+    uint64_t z = seed + value * 0x9E3779B97F4A7C15ull + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+//Vehicles of lane with enter frame <= frame
+static int countUpTo(int offset, int period, int frame) {
+    return frame >= offset ? (frame - offset) / period + 1 : 0;
+}
+
+
+SyntheticTraffic::SyntheticTraffic(const TrafficParams &params) : trafficParams(params) {
+    const cv::Size &size = params.vehicleSize;
+    if (params.width < 1 || params.height < 1 || params.lanes < 1 || params.vehicles < 1 || params.speed <= 0 ||
+        size.width < 1 || size.height < 1 || size.height > params.height / params.lanes) {
+        CV_Error(cv::Error::StsBadArg, "Synthetic traffic: vehicles must fit their lanes and move");
+    }
+    int laneHeight = params.height / params.lanes;
+    double vehiclesPerLane = (double)params.vehicles / params.lanes;
+    for (int lane = 0; lane < params.lanes; lane++) {
+        Lane setup;
+        double jitter = (mix(params.seed, lane) % 2001) / 1000.0 - 1.0;
+        setup.speed = params.speed * (1.0 + 0.2 * jitter) * (lane % 2 == 0 ? 1 : -1);
+        setup.y = lane * laneHeight + (laneHeight - size.height) / 2;
+        //A vehicle is visible while it has moved less than the frame width plus its length
+        setup.framesOnScreen = (int)std::ceil((params.width + size.width) / std::abs(setup.speed)) - 1;
+        int minPeriod = (int)std::ceil(1.5 * size.width / std::abs(setup.speed));
+        setup.period = std::max({1, minPeriod, (int)std::lround(setup.framesOnScreen / vehiclesPerLane)});
+        setup.offset = (int)(mix(params.seed ^ 0x5A5A5A5Aull, lane) % (uint64_t)setup.period);
+        laneSetup.push_back(setup);
+    }
+
+    for (int i = 0; i < TEXTURE_COUNT; i++) {
+        cv::RNG rng(mix(params.seed, 1000 + i));
+        cv::Mat texture(size, CV_8UC3);
+        for (int y = 0; y < size.height; y += TEXTURE_BLOCK) {
+            for (int x = 0; x < size.width; x += TEXTURE_BLOCK) {
+                cv::Scalar color(rng.uniform(90, 256), rng.uniform(90, 256), rng.uniform(90, 256));
+                cv::rectangle(texture, cv::Rect(x, y, TEXTURE_BLOCK, TEXTURE_BLOCK), color, -1);
+            }
+        }
+        textures.push_back(texture);
+    }
+}
+
+
+//Vehicles are numbered by enter frame, then by lane
+int SyntheticTraffic::idOf(int lane, int k) const {
+    int enter = enterFrame(lane, k);
+    int id = 0;
+    for (int other = 0; other < (int)laneSetup.size(); other++) {
+        const Lane &setup = laneSetup[other];
+        id += countUpTo(setup.offset, setup.period, other < lane ? enter : enter - 1);
+    }
+    return id;
+}
+
+
+cv::Rect SyntheticTraffic::boxAt(int lane, int k, int n) const {
+    const Lane &setup = laneSetup[lane];
+    int travelled = (int)std::lround((n - enterFrame(lane, k) + 1) * std::abs(setup.speed));
+    int x = setup.speed > 0 ? travelled - trafficParams.vehicleSize.width : trafficParams.width - travelled;
+    return cv::Rect(cv::Point(x, setup.y), trafficParams.vehicleSize);
+}
+
+
+std::vector<SyntheticVehicle> SyntheticTraffic::vehiclesAt(int n) const {
+    std::vector<SyntheticVehicle> vehicles;
+    for (int lane = 0; lane < (int)laneSetup.size(); lane++) {
+        const Lane &setup = laneSetup[lane];
+        int last = countUpTo(setup.offset, setup.period, n) - 1;
+        int first = countUpTo(setup.offset, setup.period, n - setup.framesOnScreen);
+        for (int k = first; k <= last; k++) {
+            vehicles.push_back({idOf(lane, k), lane, boxAt(lane, k, n)});
+        }
+    }
+    std::sort(vehicles.begin(), vehicles.end(),
+              [](const SyntheticVehicle &a, const SyntheticVehicle &b) { return a.id < b.id; });
+    return vehicles;
+}
+
+
+int SyntheticTraffic::vehiclesEntered(int n) const {
+    int entered = 0;
+    for (const auto &setup : laneSetup) {
+        entered += countUpTo(setup.offset, setup.period, n - 1);
+    }
+    return entered;
+}
+
+
+void SyntheticTraffic::renderRoad(int n, cv::Mat &frame) const {
+    const TrafficParams &params = trafficParams;
+    frame.create(params.height, params.width, CV_8UC3);
+    cv::RNG rng(mix(params.seed, (uint64_t)n + 0x100000000ull));
+    rng.fill(frame, cv::RNG::UNIFORM, cv::Scalar::all(BACKGROUND - params.noise),
+             cv::Scalar::all(BACKGROUND + params.noise + 1));
+
+    //Dashed lane markings, static like the road they are painted on
+    int laneHeight = params.height / params.lanes;
+    for (int lane = 1; lane < params.lanes; lane++) {
+        for (int x = 0; x < params.width; x += 80) {
+            cv::rectangle(frame, cv::Rect(x, lane * laneHeight - 2, 40, 4), cv::Scalar::all(200), -1);
+        }
+    }
+}
+
+
+void SyntheticTraffic::render(int n, cv::Mat &frame) const {
+    const TrafficParams &params = trafficParams;
+    renderRoad(n, frame);
+    cv::Rect frameRect(0, 0, params.width, params.height);
+    for (int lane = 0; lane < (int)laneSetup.size(); lane++) {
+        const Lane &setup = laneSetup[lane];
+        int last = countUpTo(setup.offset, setup.period, n) - 1;
+        int first = countUpTo(setup.offset, setup.period, n - setup.framesOnScreen);
+        for (int k = first; k <= last; k++) {
+            cv::Rect box = boxAt(lane, k, n);
+            cv::Rect visible = box & frameRect;
+            if (visible.area() > 0) {
+                const cv::Mat &texture = textures[(k + lane) % TEXTURE_COUNT];
+                texture(visible - box.tl()).copyTo(frame(visible));
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef SYNTHETIC_TRAFFIC_H
+#define SYNTHETIC_TRAFFIC_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Scene of a synthetic traffic video. The defaults give 1080p frames with vehicles large enough for the
+// default detection thresholds of TrackingParams.
+struct TrafficParams {
+    int width = 1920;
+    int height = 1080;
+    int lanes = 4;              // horizontal lanes; even lanes drive to the right, odd lanes to the left
+    int vehicles = 8;           // vehicles on screen at once, on average
+    double speed = 12.0;        // pixels per frame; each lane drives up to 20% faster or slower
+    cv::Size vehicleSize = cv::Size(300, 150);
+    int noise = 20;             // background pixels are uniform in 60 +- noise
+    uint64_t seed = 1;
+};
+
+// A vehicle in a frame, the ground truth for the tracker.
+struct SyntheticVehicle {
+    int id;                     // in order of entering the frame
+    int lane;
+    cv::Rect box;               // may reach outside the frame while entering or leaving
+};
+
+// Deterministic traffic video: frame n depends only on the params and n, so any frame can be rendered on
+// its own, in any order, on any machine. Vehicles in one lane keep their spacing and never overlap.
+class SyntheticTraffic {
+public:
+    explicit SyntheticTraffic(const TrafficParams &params = TrafficParams());
+
+    // Renders frame n (0-based) into frame (8-bit BGR), reusing its buffer.
+    void render(int n, cv::Mat &frame) const;
+    // Frame n of the empty road: the same noise and lane markings, no vehicles
+    void renderRoad(int n, cv::Mat &frame) const;
+    // Vehicles at least partly inside frame n
+    std::vector<SyntheticVehicle> vehiclesAt(int n) const;
+    // Vehicles that have entered the frame in frames 0..n-1, i.e. the tracks a perfect tracker finds
+    int vehiclesEntered(int n) const;
+
+    const TrafficParams &params() const { return trafficParams; }
+
+private:
+    struct Lane {
+        double speed;           // signed, pixels per frame
+        int y;
+        int period;             // frames between two vehicles entering
+        int offset;             // frame the first vehicle enters
+        int framesOnScreen;
+    };
+
+    // Frame vehicle k of lane enters
+    int enterFrame(int lane, int k) const { return laneSetup[lane].offset + k * laneSetup[lane].period; }
+    int idOf(int lane, int k) const;
+    cv::Rect boxAt(int lane, int k, int n) const;
+
+    TrafficParams trafficParams;
+    std::vector<Lane> laneSetup;
+    std::vector<cv::Mat> textures;  // blocky patterns, so a moving vehicle differs from the previous frame all over
+};
+
+#endif    // SYNTHETIC_TRAFFIC_H
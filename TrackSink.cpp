@@ -0,0 +1,478 @@
+#include "TrackSink.h"
+#include "VideoLog.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+
+void fillSinkFrame(int frameNumber, const TrackerState &tracks, SinkFrame &frame, int64_t captureTimeMs) {
+    frame.frameNumber = frameNumber;
+    frame.captureTimeMs = captureTimeMs;
+    frame.crossings = tracks.crossings;
+    frame.tracks.clear();
+    for (const auto &blob : tracks.blobs) {
+        if (blob.blnStillBeingTracked) {
+            const cv::Rect &rect = blob.currentBoundingRect;
+            frame.tracks.push_back({blob.intId, rect.x, rect.y, rect.width, rect.height});
+        }
+    }
+}
+
+
+//Checkpoint of a text log: its size and rows
+static bool checkpointFile(std::ofstream &file, long rows, std::string &state) {
+    file.flush();
+    std::streamoff size = file.tellp();
+    if (!file || size < 0) {
+        return false;
+    }
+    state = std::to_string((long long)size) + " " + std::to_string(rows);
+    return true;
+}
+
+
+//Cuts the log back to its checkpointed size and reopens it at the end; ss is left after the common fields
+static bool resumeFile(const std::string &path, std::ofstream &file, long &rows, std::istringstream &ss) {
+    long long size;
+    if (!(ss >> size >> rows) || truncate(path.c_str(), (off_t)size) != 0) {
+        return false;
+    }
+    file.open(path, std::ios::in | std::ios::out);
+    file.seekp(0, std::ios::end);
+    return file.is_open();
+}
+
+
+bool TxtSink::open() {
+    file.open(path);
+    return file.is_open();
+}
+
+
+//'\n' rather than std::endl: the stream flushes when its buffer is full, not on every frame
+void TxtSink::write(const SinkFrame &frame) {
+    file << frame.frameNumber << " ";
+    for (const auto &track : frame.tracks) {
+        file << track.id << " " << track.x << " " << track.y << " " << track.width << " " << track.height << " ";
+    }
+    file << '\n';
+    rowCount += frame.tracks.size();
+}
+
+
+bool TxtSink::finish() {
+    file.close();
+    return !file.fail();
+}
+
+
+bool TxtSink::checkpoint(std::string &state) {
+    return checkpointFile(file, rowCount, state);
+}
+
+
+bool TxtSink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    return resumeFile(path, file, rowCount, ss);
+}
+
+
+//Frame numbers are implicit in a vclog, so the frames missing before this one (stream frames dropped or
+//skipped) are written empty to keep frame n at the n-th entry, as in the other logs
+void BinarySink::write(const SinkFrame &frame) {
+    while (frame.frameNumber > 0 && writer.frames() + 1 < (uint32_t)frame.frameNumber) {
+        if (!writer.writeFrame(nullptr, 0)) {
+            break;
+        }
+    }
+    records.clear();
+    for (const auto &track : frame.tracks) {
+        overflow = overflow || !fitsBinaryLogRecord(track.x) || !fitsBinaryLogRecord(track.y) ||
+                   !fitsBinaryLogRecord(track.width) || !fitsBinaryLogRecord(track.height);
+        records.push_back({(uint32_t)track.id, (int16_t)track.x, (int16_t)track.y,
+                           (int16_t)track.width, (int16_t)track.height});
+    }
+    writer.writeFrame(records.data(), records.size());
+    rowCount += frame.tracks.size();
+}
+
+
+bool BinarySink::checkpoint(std::string &state) {
+    uint32_t frames, records;
+    if (!writer.checkpoint(frames, records)) {
+        return false;
+    }
+    state = std::to_string(frames) + " " + std::to_string(records) + " " + std::to_string(rowCount) + " " +
+            std::to_string((int)overflow);
+    return true;
+}
+
+
+bool BinarySink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    uint32_t frames, records;
+    int overflowed;
+    if (!(ss >> frames >> records >> rowCount >> overflowed)) {
+        return false;
+    }
+    overflow = overflowed != 0;
+    return writer.resume(path, frames, records);
+}
+
+
+bool CsvSink::open() {
+    file.open(path);
+    file << "frame,time_ms,id,x,y,width,height\n";
+    return file.is_open();
+}
+
+
+void CsvSink::write(const SinkFrame &frame) {
+    std::string time = frame.captureTimeMs >= 0 ? std::to_string(frame.captureTimeMs) : "";
+    for (const auto &track : frame.tracks) {
+        file << frame.frameNumber << ',' << time << ',' << track.id << ',' << track.x << ',' << track.y << ','
+             << track.width << ',' << track.height << '\n';
+    }
+    rowCount += frame.tracks.size();
+}
+
+
+bool CsvSink::finish() {
+    file.close();
+    return !file.fail();
+}
+
+
+bool CsvSink::checkpoint(std::string &state) {
+    return checkpointFile(file, rowCount, state);
+}
+
+
+bool CsvSink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    return resumeFile(path, file, rowCount, ss);
+}
+
+
+bool JsonLinesSink::open() {
+    file.open(path);
+    return file.is_open();
+}
+
+
+void JsonLinesSink::write(const SinkFrame &frame) {
+    file << "{\"frame\":" << frame.frameNumber;
+    if (frame.captureTimeMs >= 0) {
+        file << ",\"time_ms\":" << frame.captureTimeMs;
+    }
+    file << ",\"tracks\":[";
+    for (size_t i = 0; i < frame.tracks.size(); i++) {
+        const TrackRow &track = frame.tracks[i];
+        file << (i == 0 ? "" : ",") << "{\"id\":" << track.id << ",\"x\":" << track.x << ",\"y\":" << track.y
+             << ",\"width\":" << track.width << ",\"height\":" << track.height << "}";
+    }
+    file << "]}\n";
+    rowCount += frame.tracks.size();
+}
+
+
+bool JsonLinesSink::finish() {
+    file.close();
+    return !file.fail();
+}
+
+
+bool JsonLinesSink::checkpoint(std::string &state) {
+    return checkpointFile(file, rowCount, state);
+}
+
+
+bool JsonLinesSink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    return resumeFile(path, file, rowCount, ss);
+}
+
+
+bool NullSink::checkpoint(std::string &state) {
+    state = std::to_string(rowCount);
+    return true;
+}
+
+
+bool NullSink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    return (bool)(ss >> rowCount);
+}
+
+
+CountSink::CountSink(const std::string &path, const std::vector<CountLine> &lines, double bucketSeconds, double fps)
+        : path(path), lines(lines), bucketSeconds(bucketSeconds > 0 ? bucketSeconds : 1.0), fps(fps) {
+    for (const auto &line : lines) {
+        LineCounter counter;
+        counter.forward.assign(std::max(1, line.lanes), 0);
+        counter.backward.assign(std::max(1, line.lanes), 0);
+        bucketCounts.push_back(counter);
+    }
+    totals = bucketCounts;
+}
+
+
+bool CountSink::open() {
+    file.open(path);
+    //Enough digits for epoch seconds of streams
+    file << std::setprecision(15) << "time,line,lane,direction,count\n";
+    return file.is_open();
+}
+
+
+void CountSink::write(const SinkFrame &frame) {
+    double time = frame.captureTimeMs >= 0 ? frame.captureTimeMs / 1000.0
+                                           : (fps > 0 ? frame.frameNumber / fps : (double)frame.frameNumber);
+    long frameBucket = (long)std::floor(time / bucketSeconds);
+    if (frameBucket != bucket) {
+        writeBucket();
+        bucket = frameBucket;
+    }
+    for (const auto &crossing : frame.crossings) {
+        (crossing.forward ? bucketCounts[crossing.line].forward : bucketCounts[crossing.line].backward)[crossing.lane]++;
+        (crossing.forward ? totals[crossing.line].forward : totals[crossing.line].backward)[crossing.lane]++;
+    }
+}
+
+
+void CountSink::writeBucket() {
+    for (size_t line = 0; line < lines.size(); line++) {
+        LineCounter &counter = bucketCounts[line];
+        for (size_t lane = 0; lane < counter.forward.size(); lane++) {
+            if (counter.forward[lane] > 0) {
+                file << bucket * bucketSeconds << ',' << lines[line].name << ',' << lane << ",forward,"
+                     << counter.forward[lane] << '\n';
+                rowCount++;
+            }
+            if (counter.backward[lane] > 0) {
+                file << bucket * bucketSeconds << ',' << lines[line].name << ',' << lane << ",backward,"
+                     << counter.backward[lane] << '\n';
+                rowCount++;
+            }
+            counter.forward[lane] = 0;
+            counter.backward[lane] = 0;
+        }
+    }
+}
+
+
+bool CountSink::finish() {
+    writeBucket();
+    file.close();
+    return !file.fail();
+}
+
+
+//"<size> <rows> <bucket>", then per line and lane the bucket and total counts both ways
+bool CountSink::checkpoint(std::string &state) {
+    if (!checkpointFile(file, rowCount, state)) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << " " << bucket;
+    for (size_t line = 0; line < lines.size(); line++) {
+        for (size_t lane = 0; lane < totals[line].forward.size(); lane++) {
+            ss << " " << bucketCounts[line].forward[lane] << " " << bucketCounts[line].backward[lane] << " "
+               << totals[line].forward[lane] << " " << totals[line].backward[lane];
+        }
+    }
+    state += ss.str();
+    return true;
+}
+
+
+bool CountSink::resume(const std::string &state) {
+    std::istringstream ss(state);
+    if (!resumeFile(path, file, rowCount, ss) || !(ss >> bucket)) {
+        return false;
+    }
+    for (size_t line = 0; line < lines.size(); line++) {
+        for (size_t lane = 0; lane < totals[line].forward.size(); lane++) {
+            if (!(ss >> bucketCounts[line].forward[lane] >> bucketCounts[line].backward[lane] >>
+                  totals[line].forward[lane] >> totals[line].backward[lane])) {
+                return false;
+            }
+        }
+    }
+    file << std::setprecision(15);
+    return true;
+}
+
+
+std::string CountSink::summary() const {
+    std::ostringstream ss;
+    for (size_t line = 0; line < lines.size(); line++) {
+        for (size_t lane = 0; lane < totals[line].forward.size(); lane++) {
+            ss << lines[line].name << " lane " << lane << ": " << totals[line].forward[lane] << " forward, "
+               << totals[line].backward[lane] << " backward" << std::endl;
+        }
+    }
+    return ss.str();
+}
+
+
+std::unique_ptr<TrackSink> makeFileSink(int logTypeCode, const std::string &path) {
+    if (logTypeCode < 1 || logTypeCode > TYPES_NUMBER) {
+        return nullptr;
+    }
+    const std::string &type = logTypes[logTypeCode];
+    if (type == TXT_EXT) {
+        return std::unique_ptr<TrackSink>(new TxtSink(path));
+    }
+    if (type == BIN_EXT) {
+        return std::unique_ptr<TrackSink>(new BinarySink(path));
+    }
+    if (type == CSV_EXT) {
+        return std::unique_ptr<TrackSink>(new CsvSink(path));
+    }
+    if (type == JSONL_EXT) {
+        return std::unique_ptr<TrackSink>(new JsonLinesSink(path));
+    }
+    return nullptr;
+}
+
+
+AsyncTrackWriter::AsyncTrackWriter(const std::vector<TrackSink *> &sinks, int batchFrames)
+        : sinks(sinks), batchFrames((size_t)std::max(1, batchFrames)) {
+    writer = std::thread(&AsyncTrackWriter::run, this);
+}
+
+
+AsyncTrackWriter::~AsyncTrackWriter() {
+    if (!finished) {
+        try {
+            finish();
+        } catch (...) {
+        }
+    }
+}
+
+
+void AsyncTrackWriter::add(int frameNumber, const TrackerState &tracks, int64_t captureTimeMs) {
+    //Frame slots and their track vectors are reused, so steady state allocates nothing
+    if (fillingCount == filling.size()) {
+        filling.emplace_back();
+    }
+    fillSinkFrame(frameNumber, tracks, filling[fillingCount++], captureTimeMs);
+    if (fillingCount >= batchFrames) {
+        handOver();
+    }
+}
+
+
+void AsyncTrackWriter::add(const SinkFrame &frame) {
+    if (fillingCount == filling.size()) {
+        filling.emplace_back();
+    }
+    filling[fillingCount++] = frame;
+    if (fillingCount >= batchFrames) {
+        handOver();
+    }
+}
+
+
+void AsyncTrackWriter::waitForWriter() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !writerBusy; });
+}
+
+
+bool AsyncTrackWriter::checkpoint(std::vector<std::string> &states) {
+    if (fillingCount > 0) {
+        handOver();
+    }
+    waitForWriter();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    states.assign(sinks.size(), std::string());
+    for (size_t i = 0; i < sinks.size(); i++) {
+        if (!sinks[i]->checkpoint(states[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void AsyncTrackWriter::handOver() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (writerBusy) {
+        VC_TIME_STAGE(SinkWait);
+        changed.wait(lock, [this] { return !writerBusy; });
+    }
+    VC_OBSERVE(WriterBatch, fillingCount);
+    std::swap(filling, writing);
+    writingCount = fillingCount;
+    fillingCount = 0;
+    writerBusy = true;
+    changed.notify_all();
+}
+
+
+void AsyncTrackWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return writerBusy || stopping; });
+        if (!writerBusy) {
+            return;
+        }
+        lock.unlock();
+        //After a failure the remaining frames are dropped; finish() reports it
+        if (!error) {
+            try {
+                for (size_t i = 0; i < writingCount; i++) {
+                    for (auto sink : sinks) {
+                        VC_TIME_STAGE(SinkWrite);
+                        sink->write(writing[i]);
+                    }
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        lock.lock();
+        writerBusy = false;
+        changed.notify_all();
+    }
+}
+
+
+bool AsyncTrackWriter::finish() {
+    if (finished) {
+        return !error;
+    }
+    finished = true;
+    if (fillingCount > 0) {
+        handOver();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        changed.notify_all();
+    }
+    writer.join();
+
+    bool ok = true;
+    for (auto sink : sinks) {
+        try {
+            ok = sink->finish() && ok;
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return ok;
+}
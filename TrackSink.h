@@ -0,0 +1,210 @@
+#ifndef TRACK_SINK_H
+#define TRACK_SINK_H
+
+#include "Tracking.h"
+#include "BinaryLog.h"
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One live track in a logged frame.
+struct TrackRow {
+    int id;
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// What sinks receive for every tracked frame: a copy of the live tracks, so the tracker can go on.
+struct SinkFrame {
+    int frameNumber;
+    int64_t captureTimeMs = -1;     // wall clock of a stream frame (ms since the epoch), -1 for files
+    std::vector<TrackRow> tracks;
+    std::vector<LineCrossing> crossings;
+};
+
+// Fills frame with the live tracks (blnStillBeingTracked) and the crossings of tracks, reusing its vectors.
+void fillSinkFrame(int frameNumber, const TrackerState &tracks, SinkFrame &frame, int64_t captureTimeMs = -1);
+
+// Destination of a tracking log. open() runs before tracking starts, write() and finish() on the
+// writer thread of AsyncTrackWriter, never concurrently.
+class TrackSink {
+public:
+    virtual ~TrackSink() = default;
+    virtual bool open() = 0;
+    virtual void write(const SinkFrame &frame) = 0;
+    // Completes the log; false if anything failed.
+    virtual bool finish() = 0;
+    // Where the log goes, for messages
+    virtual std::string name() const = 0;
+    // Rows written so far
+    long rows() const { return rowCount; }
+
+    // Checkpoints (Checkpoint.h). checkpoint() makes everything written so far durable and describes it in
+    // state; resume() is called instead of open() and continues the log from such a state, dropping anything
+    // written after it. Called between write()s, never concurrently with them. Sinks that cannot resume
+    // return false.
+    virtual bool checkpoint(std::string &) { return false; }
+    virtual bool resume(const std::string &) { return false; }
+
+protected:
+    long rowCount = 0;
+};
+
+// "<frame> <id> <x> <y> <width> <height> ..." per line, the original log format
+class TxtSink : public TrackSink {
+public:
+    explicit TxtSink(const std::string &path) : path(path) {}
+    bool open() override;
+    void write(const SinkFrame &frame) override;
+    bool finish() override;
+    std::string name() const override { return path; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+private:
+    std::string path;
+    std::ofstream file;
+};
+
+class BinarySink : public TrackSink {
+public:
+    explicit BinarySink(const std::string &path) : path(path) {}
+    bool open() override { return writer.open(path); }
+    void write(const SinkFrame &frame) override;
+    // False also if a box did not fit the 16-bit record fields
+    bool finish() override { return writer.close() && !overflow; }
+    std::string name() const override { return path; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+private:
+    std::string path;
+    BinaryLogWriter writer;
+    std::vector<BinaryLogRecord> records;
+    bool overflow = false;
+};
+
+// "frame,time_ms,id,x,y,width,height" header, then one line per track; time_ms is empty for files
+class CsvSink : public TrackSink {
+public:
+    explicit CsvSink(const std::string &path) : path(path) {}
+    bool open() override;
+    void write(const SinkFrame &frame) override;
+    bool finish() override;
+    std::string name() const override { return path; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+private:
+    std::string path;
+    std::ofstream file;
+};
+
+// {"frame":1,"tracks":[{"id":0,"x":1,"y":2,"width":3,"height":4}]} per line, with "time_ms" after
+// "frame" for streams
+class JsonLinesSink : public TrackSink {
+public:
+    explicit JsonLinesSink(const std::string &path) : path(path) {}
+    bool open() override;
+    void write(const SinkFrame &frame) override;
+    bool finish() override;
+    std::string name() const override { return path; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+private:
+    std::string path;
+    std::ofstream file;
+};
+
+// Discards everything; measures tracking without output costs.
+class NullSink : public TrackSink {
+public:
+    bool open() override { return true; }
+    void write(const SinkFrame &frame) override { rowCount += frame.tracks.size(); }
+    bool finish() override { return true; }
+    std::string name() const override { return "null"; }
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+};
+
+// Count line totals per time bucket: "time,line,lane,direction,count" rows, only for counts that are not 0.
+// time is the start of the bucket in seconds: video time for files (frame / fps), the capture time
+// since the epoch for streams. Without a frame rate files are bucketed by frames instead of seconds.
+class CountSink : public TrackSink {
+public:
+    CountSink(const std::string &path, const std::vector<CountLine> &lines, double bucketSeconds, double fps);
+    bool open() override;
+    void write(const SinkFrame &frame) override;
+    bool finish() override;
+    std::string name() const override { return path; }
+    // Also keeps the counts of the open bucket and the totals
+    bool checkpoint(std::string &state) override;
+    bool resume(const std::string &state) override;
+
+    // Totals since open(): "<line> lane <n>: <forward> forward, <backward> backward" per lane
+    std::string summary() const;
+
+private:
+    void writeBucket();
+
+    std::string path;
+    std::vector<CountLine> lines;
+    double bucketSeconds;
+    double fps;
+    std::ofstream file;
+    long bucket = -1;
+    std::vector<LineCounter> bucketCounts;
+    std::vector<LineCounter> totals;
+};
+
+// File sink for a log type code of logTypes (VideoLog.h), or nullptr for the database and unknown codes.
+std::unique_ptr<TrackSink> makeFileSink(int logTypeCode, const std::string &path);
+
+// Feeds frames to sinks on a writer thread. Frames are collected in one batch while the previous
+// batch is written, so the tracker only waits if the sinks fall a whole batch behind.
+class AsyncTrackWriter {
+public:
+    AsyncTrackWriter(const std::vector<TrackSink *> &sinks, int batchFrames = 64);
+    ~AsyncTrackWriter();
+
+    void add(int frameNumber, const TrackerState &tracks, int64_t captureTimeMs = -1);
+    // A frame filled elsewhere, e.g. by trackVideoSegmented
+    void add(const SinkFrame &frame);
+    // Writes every frame added so far, then checkpoints each sink into states (one per sink).
+    // False if a sink cannot checkpoint; a sink's write error is rethrown.
+    bool checkpoint(std::vector<std::string> &states);
+    // Writes what is left, stops the thread and finishes every sink. False if any sink failed;
+    // the first exception thrown by a sink is rethrown.
+    bool finish();
+
+private:
+    void handOver();
+    void waitForWriter();
+    void run();
+
+    std::vector<TrackSink *> sinks;
+    size_t batchFrames;
+    std::vector<SinkFrame> filling;
+    size_t fillingCount = 0;
+    std::vector<SinkFrame> writing;
+    size_t writingCount = 0;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool writerBusy = false;
+    bool stopping = false;
+    bool finished = false;
+    std::exception_ptr error;
+    std::thread writer;
+};
+
+#endif    // TRACK_SINK_H
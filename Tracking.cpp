@@ -0,0 +1,424 @@
+#include "Tracking.h"
+#include "TrackingPipeline.h"
+#include "MotionDetector.h"
+#include "BlobGrid.h"
+#include "ProcessingRegion.h"
+#include "FrameSource.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iostream>
+
+
+//The last frame reported by FRAME_COUNT is never read, so logs always hold FRAME_COUNT - 2 lines.
+bool readNextFrame(cv::VideoCapture &videoCapture, cv::Mat &frame) {
+    if ((videoCapture.get(CV_CAP_PROP_POS_FRAMES) + 1) < videoCapture.get(CV_CAP_PROP_FRAME_COUNT)) {
+        videoCapture.read(frame);
+        return true;
+    }
+    return false;
+}
+
+
+bool skipNextFrame(cv::VideoCapture &videoCapture) {
+    if ((videoCapture.get(CV_CAP_PROP_POS_FRAMES) + 1) < videoCapture.get(CV_CAP_PROP_FRAME_COUNT)) {
+        return videoCapture.grab();
+    }
+    return false;
+}
+
+
+bool readNextFrame(FrameSource &source, cv::Mat &frame) {
+    if (source.position() + 1 < source.frameCount()) {
+        source.read(frame);
+        return true;
+    }
+    return false;
+}
+
+
+bool skipNextFrame(FrameSource &source) {
+    if (source.position() + 1 < source.frameCount()) {
+        return source.grab();
+    }
+    return false;
+}
+
+
+int trackVideo(cv::VideoCapture &videoCapture, const TrackingParams &params, const FrameCallback &onFrame) {
+    TrackerState tracks;
+    return trackVideo(videoCapture, params, onFrame, tracks);
+}
+
+
+int trackVideo(cv::VideoCapture &videoCapture, const TrackingParams &params, const FrameCallback &onFrame,
+               TrackerState &tracks) {
+    CaptureSource source(videoCapture);
+    return trackVideo(source, params, onFrame, tracks);
+}
+
+
+//Frame n of the video (counting from 0) is the one matched as tracks.frame == n, so the source is moved
+//to the last matched frame to read it once more as the previous frame
+int trackVideo(FrameSource &source, const TrackingParams &sourceParams, const FrameCallback &onFrame,
+               TrackerState &tracks) {
+    if (tracks.frame > 0) {
+        source.seek(tracks.frame);
+    }
+    //Differences of limited range luma are smaller than those of the gray converted from BGR
+    TrackingParams params = sourceParams;
+    if (source.luma()) {
+        params.diffThreshold *= source.grayScale();
+    }
+    if (params.pipelined) {
+        return trackVideoPipelined(source, params, onFrame, tracks);
+    }
+
+    std::unique_ptr<MotionDetector> detector = createMotionDetector(params);
+    cv::Mat frame;
+    std::vector<Blob> curFrameBlobs;
+    ContourBuffers contourBuffers;
+    int frames = 0;
+    const int stride = std::max(1, params.frameStride);
+
+    //Frame number reads is the one matched as tracks.frame == reads
+    for (int reads = tracks.frame; params.lastFrame <= 0 || reads <= params.lastFrame; reads++) {
+        //With a stride, only the frames numbered a multiple of it are decoded and tracked, so a resumed run
+        //tracks the same frames as an uninterrupted one
+        bool skipped = reads % stride != 0;
+        {
+            VC_TIME_STAGE(Decode);
+            if (reads < 2) {
+                skipped ? source.grab() : source.read(frame);
+            } else if (skipped ? !skipNextFrame(source) : !readNextFrame(source, frame)) {
+                std::cout << "end of video\n";
+                break;
+            }
+        }
+        try {
+            if (skipped) {
+                extrapolateTracks(tracks, params);
+            } else {
+                if (!detector->apply(frame)) {
+                    continue;
+                }
+                curFrameBlobs.clear();
+                if (detector->moved()) {
+                    extractBlobs(detector->mask(), frame.size(), curFrameBlobs, params, contourBuffers);
+                }
+                matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+            }
+        } catch(cv::Exception &e) {
+            std::cout << e.msg;
+            std::cout << "That's all Folks!" << std::endl;
+            break;
+        }
+        onFrame(tracks);
+        frames++;
+
+        //for debugging
+//        std::cout << frames << " " << tracks.blobs.size() << std::endl;
+//        cv::imshow("curFrame", frame);
+
+    }
+    return frames;
+}
+
+
+void track2Frames(cv::Mat &prevFrame, cv::Mat &curFrame, TrackerState &tracks, const TrackingParams &params) {
+    std::vector<Blob> curFrameBlobs;
+    cv::Mat imgThreshold = preprocessFrames(prevFrame, curFrame, params);
+    extractBlobs(imgThreshold, curFrame.size(), curFrameBlobs, params);
+    matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+}
+
+
+//Stateless reference implementation; the tracking loops use FrameDiffer (the default MotionDetector), which gives
+//the same mask.
+cv::Mat preprocessFrames(const cv::Mat &prevFrame, const cv::Mat &curFrame, const TrackingParams &params) {
+    ProcessingRegion region(params);
+    cv::Mat prevFrameCopy = region.apply(prevFrame).clone();
+    cv::Mat curFrameCopy = region.apply(curFrame).clone();
+    cv::Mat imgDifference;
+    cv::Mat imgThreshold;
+    cv::cvtColor(prevFrameCopy, prevFrameCopy, CV_BGR2GRAY);
+    cv::cvtColor(curFrameCopy, curFrameCopy, CV_BGR2GRAY);
+    cv::GaussianBlur(prevFrameCopy, prevFrameCopy, cv::Size(5, 5), 0);
+    cv::GaussianBlur(curFrameCopy, curFrameCopy, cv::Size(5, 5), 0);
+    cv::absdiff(prevFrameCopy, curFrameCopy, imgDifference);
+    cv::threshold(imgDifference, imgThreshold, params.diffThreshold, 255.0, CV_THRESH_BINARY);
+    cv::Mat structuringElement5x5 = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+
+    for (unsigned int i = 0; i < 2; i++) {
+        cv::dilate(imgThreshold, imgThreshold, structuringElement5x5);
+        cv::dilate(imgThreshold, imgThreshold, structuringElement5x5);
+        cv::erode(imgThreshold, imgThreshold, structuringElement5x5);
+    }
+    region.maskOutside(imgThreshold);
+    return imgThreshold;
+}
+
+
+void extractBlobs(cv::Mat &imgThreshold, const cv::Size &frameSize, std::vector<Blob> &curFrameBlobs,
+                  const TrackingParams &params) {
+    ContourBuffers buffers;
+    extractBlobs(imgThreshold, frameSize, curFrameBlobs, params, buffers);
+}
+
+
+//The size and shape thresholds, measured as Blob measures its bounding rect
+static bool boundingRectAccepted(const cv::Rect &boundingRect, const TrackingParams &params, double scale) {
+    if (boundingRect.area() <= params.minBlobArea * scale * scale || boundingRect.width <= params.minBlobWidth * scale ||
+        boundingRect.height <= params.minBlobHeight * scale) {
+        return false;
+    }
+    double aspectRatio = (float)boundingRect.width / (float)boundingRect.height;
+    double diagonalSize = sqrt(pow(boundingRect.width, 2) + pow(boundingRect.height, 2));
+    return aspectRatio > params.minAspectRatio && aspectRatio < params.maxAspectRatio &&
+           diagonalSize > params.minBlobDiagonal * scale;
+}
+
+
+//findContours overwrites imgThreshold. The mask comes from the ProcessingRegion, so the size thresholds are
+//scaled to it and accepted boxes are mapped back to the source frame.
+//A convex hull has the bounding rect of its contour, so most contours are rejected on that rect alone; only the
+//ones left get a hull, for the fill ratio.
+void extractBlobs(cv::Mat &imgThreshold, const cv::Size &frameSize, std::vector<Blob> &curFrameBlobs,
+                  const TrackingParams &params, ContourBuffers &buffers) {
+    const double scale = params.processingScale;
+    const bool sourceCoordinates = params.roi.empty() && scale == 1.0;
+    const ProcessingMap map = sourceCoordinates ? ProcessingMap() : processingMap(params, frameSize);
+    std::vector<std::vector<cv::Point>> &contours = buffers.contours;
+    {
+        VC_TIME_STAGE(Contours);
+        cv::findContours(imgThreshold, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    }
+    VC_TIME_STAGE(Filter);
+    VC_OBSERVE(Contours, contours.size());
+    [[maybe_unused]] const size_t blobsBefore = curFrameBlobs.size();
+
+    //for debugging
+//    std::cout << contours.size() << std::endl;
+
+    for (const auto &contour : contours) {
+        cv::Rect boundingRect = cv::boundingRect(contour);
+        if (!boundingRectAccepted(boundingRect, params, scale)) {
+            continue;
+        }
+        cv::convexHull(contour, buffers.convexHull);
+        if ((cv::contourArea(buffers.convexHull) / (double)boundingRect.area()) > params.minFillRatio) {
+            curFrameBlobs.emplace_back(sourceCoordinates ? boundingRect : processingRectToSource(boundingRect, map));
+        }
+    }
+
+    //for debugging
+//    std::cout << curFrameBlobs.size() << std::endl;
+    VC_OBSERVE(BlobsAccepted, curFrameBlobs.size() - blobsBefore);
+}
+
+
+void matchCurrentFrameBlobsToExistingBlobs(TrackerState &tracks, std::vector<Blob> &currentFrameBlobs,
+                                           const TrackingParams &params) {
+    VC_TIME_STAGE(Match);
+    std::vector<Blob> &existingBlobs = tracks.blobs;
+    tracks.frame++;
+    tracks.crossings.clear();
+    for (auto &existingBlob : existingBlobs) {
+        existingBlob.blnCurrentMatchFoundOrNewBlob = false;
+        existingBlob.predictNextPosition();
+    }
+
+    BlobGrid grid(params.gridCellSize);
+    grid.build(existingBlobs);
+
+    if (params.matchMode == MatchMode::Greedy) {
+        assignBlobsGreedy(tracks, currentFrameBlobs, grid);
+    } else {
+        for (auto &currentFrameBlob : currentFrameBlobs) {
+            int index = grid.nearest(existingBlobs, currentFrameBlob.centerPositions.back(),
+                                     currentFrameBlob.dblCurrentDiagonalSize * 0.5);
+            if (index >= 0) {
+                updateExistingBlob(currentFrameBlob, tracks, index);
+            }
+            else {
+                addNewBlob(currentFrameBlob, tracks);
+                //A track created in this frame is a candidate for later detections of the same frame
+                grid.insert((int)existingBlobs.size() - 1, existingBlobs.back().predictedNextPosition);
+            }
+        }
+    }
+    if (!params.countLines.empty()) {
+        countLineCrossings(tracks, params);
+    }
+
+    for (auto &existingBlob : existingBlobs) {
+        if (existingBlob.blnCurrentMatchFoundOrNewBlob) {
+            existingBlob.intNumOfConsecutiveFramesWithoutAMatch++;
+        }
+        if (existingBlob.intNumOfConsecutiveFramesWithoutAMatch >= 5 ||
+            (params.maxIdleFrames > 0 && tracks.frame - existingBlob.intLastFrame >= params.maxIdleFrames)) {
+            existingBlob.blnStillBeingTracked = false;
+        }
+    }
+    retireDeadBlobs(tracks, params);
+    VC_OBSERVE(LiveTracks, existingBlobs.size());
+}
+
+
+//Global greedy assignment: closest (detection, track) pairs first, each detection and track used at most once
+void assignBlobsGreedy(TrackerState &tracks, std::vector<Blob> &currentFrameBlobs, const BlobGrid &grid) {
+    struct Candidate {
+        double distance;
+        int current;
+        int existing;
+    };
+    std::vector<Candidate> candidates;
+    for (unsigned int i = 0; i < currentFrameBlobs.size(); i++) {
+        grid.forEachWithin(tracks.blobs, currentFrameBlobs[i].centerPositions.back(),
+                           currentFrameBlobs[i].dblCurrentDiagonalSize * 0.5, [&](int index, double distance) {
+            candidates.push_back({distance, (int)i, index});
+        });
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.distance != b.distance) {
+            return a.distance < b.distance;
+        }
+        return a.current != b.current ? a.current < b.current : a.existing < b.existing;
+    });
+
+    std::vector<bool> currentAssigned(currentFrameBlobs.size(), false);
+    std::vector<bool> existingAssigned(tracks.blobs.size(), false);
+    for (const auto &candidate : candidates) {
+        if (!currentAssigned[candidate.current] && !existingAssigned[candidate.existing]) {
+            currentAssigned[candidate.current] = true;
+            existingAssigned[candidate.existing] = true;
+            int index = candidate.existing;
+            updateExistingBlob(currentFrameBlobs[candidate.current], tracks, index);
+        }
+    }
+    for (unsigned int i = 0; i < currentFrameBlobs.size(); i++) {
+        if (!currentAssigned[i]) {
+            addNewBlob(currentFrameBlobs[i], tracks);
+        }
+    }
+}
+
+
+void updateExistingBlob(Blob &currentFrameBlob, TrackerState &tracks, int &index) {
+    Blob &existingBlob = tracks.blobs[index];
+    existingBlob.dblPathLength += distanceBetweenPoints(existingBlob.centerPositions.back(),
+                                                        currentFrameBlob.centerPositions.back());
+    existingBlob.currentBoundingRect = currentFrameBlob.currentBoundingRect;
+    existingBlob.centerPositions.push_back(currentFrameBlob.centerPositions.back());
+    existingBlob.dblCurrentDiagonalSize = currentFrameBlob.dblCurrentDiagonalSize;
+    existingBlob.dblCurrentAspectRatio = currentFrameBlob.dblCurrentAspectRatio;
+    existingBlob.blnStillBeingTracked = true;
+    existingBlob.blnCurrentMatchFoundOrNewBlob = true;
+    existingBlob.intLastFrame = tracks.frame;
+}
+
+
+static double cross(const cv::Point2d &u, const cv::Point2d &v) {
+    return u.x * v.y - u.y * v.x;
+}
+
+
+//Only tracks matched in this frame moved, so only their last step (the last two centers) is tested
+void countLineCrossings(TrackerState &tracks, const TrackingParams &params) {
+    if (tracks.lineCounts.size() != params.countLines.size()) {
+        tracks.lineCounts.resize(params.countLines.size());
+        for (size_t i = 0; i < params.countLines.size(); i++) {
+            tracks.lineCounts[i].forward.assign(std::max(1, params.countLines[i].lanes), 0);
+            tracks.lineCounts[i].backward.assign(std::max(1, params.countLines[i].lanes), 0);
+        }
+    }
+    int lines = std::min((int)params.countLines.size(), MAX_COUNT_LINES);
+
+    for (auto &blob : tracks.blobs) {
+        if (blob.intLastFrame != tracks.frame || blob.intFirstFrame == tracks.frame || blob.centerPositions.size() < 2) {
+            continue;
+        }
+        cv::Point2d from = blob.centerPositions[blob.centerPositions.size() - 2];
+        cv::Point2d to = blob.centerPositions.back();
+        for (int i = 0; i < lines; i++) {
+            const CountLine &line = params.countLines[i];
+            if (blob.countedLines & (1ULL << i)) {
+                continue;
+            }
+            cv::Point2d a = line.a, b = line.b;
+            double sideFrom = cross(b - a, from - a);
+            double sideTo = cross(b - a, to - a);
+            if ((sideFrom > 0) == (sideTo > 0)) {
+                continue;
+            }
+            //Where the step meets the line, as a fraction of a->b
+            cv::Point2d hit = from + (to - from) * (sideFrom / (sideFrom - sideTo));
+            double length2 = (b - a).dot(b - a);
+            double along = length2 > 0 ? (hit - a).dot(b - a) / length2 : -1.0;
+            if (along < 0.0 || along > 1.0) {
+                continue;
+            }
+            int lanes = std::max(1, line.lanes);
+            int lane = std::min(lanes - 1, (int)(along * lanes));
+            bool forward = sideTo > 0;
+            blob.countedLines |= 1ULL << i;
+            tracks.crossings.push_back({i, lane, forward, blob.intId});
+            (forward ? tracks.lineCounts[i].forward : tracks.lineCounts[i].backward)[lane]++;
+        }
+    }
+}
+
+
+void addNewBlob(Blob &currentFrameBlob, TrackerState &tracks) {
+    currentFrameBlob.blnCurrentMatchFoundOrNewBlob = true;
+    currentFrameBlob.intId = tracks.nextId++;
+    currentFrameBlob.intFirstFrame = tracks.frame;
+    currentFrameBlob.intLastFrame = tracks.frame;
+    tracks.blobs.push_back(currentFrameBlob);
+}
+
+
+//Moves tracks that stopped being tracked from the live set into the archive, keeping the live set in id order
+void retireDeadBlobs(TrackerState &tracks, const TrackingParams &params) {
+    for (const auto &blob : tracks.blobs) {
+        if (!blob.blnStillBeingTracked && params.archiveSize > 0) {
+            tracks.archive.push_back({blob.intId, blob.intFirstFrame, blob.intLastFrame,
+                                      blob.centerPositions.first(), blob.centerPositions.back(),
+                                      blob.currentBoundingRect, blob.centerPositions.total(), blob.dblPathLength});
+            if (tracks.archive.size() > (size_t)params.archiveSize) {
+                tracks.archive.pop_front();
+            }
+        }
+    }
+    tracks.blobs.erase(std::remove_if(tracks.blobs.begin(), tracks.blobs.end(), [](const Blob &blob) {
+        return !blob.blnStillBeingTracked;
+    }), tracks.blobs.end());
+}
+
+
+//A frame skipped by the stride: nothing is detected or matched, but tracks matched in the last tracked frame
+//move on by their share of the step predictNextPosition expects, so every frame gets plausible boxes. The
+//centers stay those of the tracked frames, which is what prediction, matching and count lines work on.
+void extrapolateTracks(TrackerState &tracks, const TrackingParams &params) {
+    const int stride = std::max(1, params.frameStride);
+    tracks.frame++;
+    tracks.crossings.clear();
+    for (auto &blob : tracks.blobs) {
+        int elapsed = tracks.frame - blob.intLastFrame;
+        if (elapsed >= stride || blob.centerPositions.size() < 2) {
+            continue;
+        }
+        blob.predictNextPosition();
+        cv::Point step = blob.predictedNextPosition - blob.centerPositions.back();
+        //The box is elapsed / stride of the step away from the tracked frame, without rounding adding up
+        blob.currentBoundingRect.x += step.x * elapsed / stride - step.x * (elapsed - 1) / stride;
+        blob.currentBoundingRect.y += step.y * elapsed / stride - step.y * (elapsed - 1) / stride;
+    }
+}
+
+
+double distanceBetweenPoints(const cv::Point& point1, const cv::Point& point2) {
+    int intX = abs(point1.x - point2.x);
+    int intY = abs(point1.y - point2.y);
+
+    return(sqrt(pow(intX, 2) + pow(intY, 2)));
+}
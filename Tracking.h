@@ -0,0 +1,174 @@
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include "Blob.h"
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+class BlobGrid;
+class FrameSource;
+
+// How detections of a frame are matched to live tracks.
+enum class MatchMode {
+    Nearest,    // every detection takes its nearest track, in detection order (original behaviour)
+    Greedy      // closest pairs first, so two detections never claim the same track
+};
+
+// How motion is found in a frame (MotionDetector.h).
+enum class DetectorMode {
+    FrameDiff,          // difference of consecutive frames (original behaviour)
+    RunningAverage,     // difference to an exponentially averaged background
+    Mog2                // OpenCV's Gaussian mixture background model
+};
+
+// Virtual count line from a to b, divided into lanes of equal width along it. A track crossing it from
+// the left of a->b (as seen on screen, facing from a to b) to the right counts as forward, the other way
+// as backward. Each track is counted at most once per line.
+struct CountLine {
+    std::string name;
+    cv::Point a;
+    cv::Point b;
+    int lanes = 1;
+};
+
+const int MAX_COUNT_LINES = 64;     // bits of Blob::countedLines
+
+// A track crossing a count line in the current frame.
+struct LineCrossing {
+    int line;               // index in TrackingParams::countLines
+    int lane;
+    bool forward;
+    int trackId;
+};
+
+// Totals of one count line since the start, per lane.
+struct LineCounter {
+    std::vector<long> forward;
+    std::vector<long> backward;
+};
+
+// Settings of the tracking loop. Detection thresholds default to the values the tracker has always used.
+struct TrackingParams {
+    double diffThreshold = 30.0;
+    int minBlobArea = 32000;
+    int minBlobWidth = 128;
+    int minBlobHeight = 128;
+    double minBlobDiagonal = 256.0;
+    double minAspectRatio = 1.2;
+    double maxAspectRatio = 4.0;
+    double minFillRatio = 0.5;
+
+    // Polygon in source pixels (e.g. the road lanes) detection is limited to; empty means the whole frame
+    std::vector<cv::Point> roi;
+    // Detection runs on frames resized by this factor (0 < scale <= 1). Boxes are mapped back to source
+    // coordinates and the size thresholds above are scaled to match, so they stay in source pixels.
+    double processingScale = 1.0;
+
+    // Evaluated in every matching step from the last two centers of each matched track
+    std::vector<CountLine> countLines;
+
+    MatchMode matchMode = MatchMode::Nearest;
+    int gridCellSize = 256;
+
+    // Finished tracks kept in TrackerState::archive (oldest dropped first), 0 keeps none
+    int archiveSize = 4096;
+    // Retire tracks not matched for this many frames. 0 never does, which is the original behaviour
+    // (only matched tracks age out), so a track that is never seen again stays live.
+    int maxIdleFrames = 0;
+
+    // Use the fused SIMD preprocessing kernel (FusedPreprocess.h) for 8-bit BGR frames
+    bool fusedPreprocessing = false;
+
+    DetectorMode detector = DetectorMode::FrameDiff;
+    // Share of the current frame blended into the background per frame (background detectors). Stopped
+    // vehicles fade into the background after a few times 1 / backgroundRate frames.
+    double backgroundRate = 0.005;
+    // Largest background model in bytes; bigger processed images are modelled at a reduced resolution
+    size_t backgroundMemoryBudget = 64u << 20;
+
+    // Frame differencing first compares frames reduced by this factor and skips the full-size difference,
+    // morphology and blob extraction when nothing changed there (no detections for the frame). 0 is off.
+    int motionGateScale = 0;
+    // Process every frameStride-th frame; the frames in between are only grabbed and logged with the tracks
+    // matched in the last processed frame moved along their predicted step (extrapolateTracks)
+    int frameStride = 1;
+    // Stop after the frame numbered so in logs (tracks.frame), 0 tracks to the end of the video
+    int lastFrame = 0;
+
+    // Run decoding, preprocessing and blob extraction on their own threads (see TrackingPipeline.h)
+    bool pipelined = false;
+    int pipelineQueueSize = 8;
+};
+
+// Summary of a finished track.
+struct TrackRecord {
+    int id;
+    int firstFrame;
+    int lastFrame;
+    cv::Point firstCenter;
+    cv::Point lastCenter;
+    cv::Rect lastBoundingRect;
+    long centers;           // frames the track was seen in
+    double pathLength;      // pixels travelled by its center
+};
+
+// What the tracker keeps between frames. Only live tracks are in blobs, in id (= creation) order;
+// ids count up from 0 in the order tracks are created.
+struct TrackerState {
+    std::vector<Blob> blobs;
+    std::deque<TrackRecord> archive;
+    int nextId = 0;
+    int frame = 0;          // frames matched so far, i.e. the number of the current frame during matching
+    std::vector<LineCrossing> crossings;    // count line crossings of the current frame
+    std::vector<LineCounter> lineCounts;    // one per TrackingParams::countLines
+};
+
+// Contours of a mask and the hull of the one being measured. Kept from frame to frame, so the point buffers
+// allocated for one frame's contours are reused by the next instead of allocated again for every contour.
+struct ContourBuffers {
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Point> convexHull;
+};
+
+// Called once per tracked frame pair with the tracker after matching: the live tracks in tracks.blobs
+// and the count line crossings of the frame in tracks.crossings. With frameStride > 1 also once for every
+// frame skipped in between, after extrapolateTracks.
+typedef std::function<void(TrackerState &tracks)> FrameCallback;
+
+// Tracks a whole video and returns the number of frame pairs passed to onFrame.
+int trackVideo(cv::VideoCapture &videoCapture, const TrackingParams &params, const FrameCallback &onFrame);
+// Continues tracks, e.g. restored from a checkpoint: with tracks.frame > 0 the capture is moved back to the
+// frame it was taken at, which primes the frame differencing, and tracking goes on from the next one.
+int trackVideo(cv::VideoCapture &videoCapture, const TrackingParams &params, const FrameCallback &onFrame,
+               TrackerState &tracks);
+// The same with frames from source (FrameSource.h), e.g. luma frames decoded by FFmpeg. The capture overloads
+// read through a CaptureSource.
+int trackVideo(FrameSource &source, const TrackingParams &params, const FrameCallback &onFrame,
+               TrackerState &tracks);
+bool readNextFrame(cv::VideoCapture &videoCapture, cv::Mat &frame);
+bool readNextFrame(FrameSource &source, cv::Mat &frame);
+// Moves past the next frame without decoding it, with the same end as readNextFrame
+bool skipNextFrame(cv::VideoCapture &videoCapture);
+bool skipNextFrame(FrameSource &source);
+void track2Frames(cv::Mat &prevFrame, cv::Mat &curFrame, TrackerState &tracks,
+                  const TrackingParams &params = TrackingParams());
+cv::Mat preprocessFrames(const cv::Mat &prevFrame, const cv::Mat &curFrame, const TrackingParams &params);
+// imgThreshold is a mask made from source frames of frameSize, which its boxes are mapped back to
+void extractBlobs(cv::Mat &imgThreshold, const cv::Size &frameSize, std::vector<Blob> &curFrameBlobs,
+                  const TrackingParams &params);
+// Same, reusing buffers from the previous call: the tracking loops keep one per loop
+void extractBlobs(cv::Mat &imgThreshold, const cv::Size &frameSize, std::vector<Blob> &curFrameBlobs,
+                  const TrackingParams &params, ContourBuffers &buffers);
+void matchCurrentFrameBlobsToExistingBlobs(TrackerState &tracks, std::vector<Blob> &currentFrameBlobs,
+                                           const TrackingParams &params = TrackingParams());
+void assignBlobsGreedy(TrackerState &tracks, std::vector<Blob> &currentFrameBlobs, const BlobGrid &grid);
+void updateExistingBlob(Blob &currentFrameBlob, TrackerState &tracks, int &index);
+void addNewBlob(Blob &currentFrameBlob, TrackerState &tracks);
+void countLineCrossings(TrackerState &tracks, const TrackingParams &params);
+void retireDeadBlobs(TrackerState &tracks, const TrackingParams &params);
+void extrapolateTracks(TrackerState &tracks, const TrackingParams &params);
+double distanceBetweenPoints(const cv::Point& point1, const cv::Point& point2);
+
+#endif    // TRACKING_H
@@ -0,0 +1,196 @@
+#include "TrackingPipeline.h"
+#include "SpscQueue.h"
+#include "FrameSource.h"
+#include "MotionDetector.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+//skipped: frames before this one that the stride left out, which the tracker extrapolates
+struct FrameItem {
+    cv::Mat frame;
+    int skipped = 0;
+    bool last = false;
+};
+
+//quiet: the motion gate saw nothing moving, there is no mask
+struct MaskItem {
+    cv::Mat mask;
+    cv::Size frameSize;     // of the source frame, to map boxes back
+    int skipped = 0;
+    bool quiet = false;
+    bool last = false;
+};
+
+struct BlobsItem {
+    std::vector<Blob> blobs;
+    int skipped = 0;
+    bool last = false;
+};
+
+}
+
+
+int trackVideoPipelined(FrameSource &source, const TrackingParams &params, const FrameCallback &onFrame,
+                        TrackerState &tracks) {
+    size_t queueSize = (size_t)std::max(1, params.pipelineQueueSize);
+    SpscQueue<FrameItem> frames(queueSize);
+    SpscQueue<MaskItem> masks(queueSize);
+    SpscQueue<BlobsItem> detections(queueSize);
+    //Consumed frame and mask buffers travel back upstream, so steady state needs no new image buffers
+    SpscQueue<cv::Mat> freeFrames(queueSize + 2);
+    SpscQueue<cv::Mat> freeMasks(queueSize + 2);
+    //stopDecoding ends the decoder early (bad frame or shutdown), cancelled releases every blocked stage
+    std::atomic<bool> stopDecoding{false};
+    std::atomic<bool> cancelled{false};
+
+    //Decode: same frame sequence as the serial loop, every queued frame in its own buffer
+    const int firstRead = tracks.frame;
+    const int stride = std::max(1, params.frameStride);
+    std::thread decoder([&] {
+        int skipped = 0;
+        for (int i = firstRead; !stopDecoding && (params.lastFrame <= 0 || i <= params.lastFrame); i++) {
+            if (i % stride != 0) {
+                VC_TIME_STAGE(Decode);
+                if (i < 2) {
+                    source.grab();
+                } else if (!skipNextFrame(source)) {
+                    std::cout << "end of video\n";
+                    break;
+                }
+                skipped++;
+                continue;
+            }
+            FrameItem item;
+            freeFrames.pop(item.frame);
+            {
+                VC_TIME_STAGE(Decode);
+                //A capture decodes into the recycled buffer through this second header; a view of the decoder's
+                //buffer (luma sources) is only valid until the next read, so it is copied into the item
+                cv::Mat decoded = item.frame;
+                if (i < 2) {
+                    source.read(decoded);
+                } else if (!readNextFrame(source, decoded)) {
+                    std::cout << "end of video\n";
+                    break;
+                }
+                if (decoded.data != item.frame.data) {
+                    decoded.copyTo(item.frame);
+                }
+            }
+            item.skipped = skipped;
+            skipped = 0;
+            if (!frames.pushWait(std::move(item), stopDecoding)) {
+                return;
+            }
+        }
+        FrameItem last;
+        last.skipped = skipped;
+        last.last = true;
+        frames.pushWait(std::move(last), stopDecoding);
+    });
+
+    //Preprocess: only needs frame pairs, so it runs ahead of the tracker
+    std::thread preprocessor([&] {
+        std::unique_ptr<MotionDetector> detector = createMotionDetector(params);
+        FrameItem cur;
+        int skipped = 0;
+        while (frames.popWait(cur, cancelled) && !cur.last) {
+            MaskItem item;
+            skipped += cur.skipped;
+            try {
+                if (!detector->apply(cur.frame)) {
+                    freeFrames.push(std::move(cur.frame));
+                    continue;
+                }
+                item.skipped = skipped;
+                skipped = 0;
+                item.quiet = !detector->moved();
+                item.frameSize = cur.frame.size();
+                if (!item.quiet) {
+                    freeMasks.pop(item.mask);
+                    detector->mask().copyTo(item.mask);
+                }
+            } catch (cv::Exception &e) {
+                std::cout << e.msg;
+                std::cout << "That's all Folks!" << std::endl;
+                break;
+            }
+            freeFrames.push(std::move(cur.frame));
+            if (!masks.pushWait(std::move(item), cancelled)) {
+                break;
+            }
+        }
+        stopDecoding = true;
+        MaskItem last;
+        last.skipped = skipped + (cur.last ? cur.skipped : 0);
+        last.last = true;
+        masks.pushWait(std::move(last), cancelled);
+    });
+
+    //Contours, convex hulls and blob filtering
+    std::thread extractor([&] {
+        MaskItem item;
+        ContourBuffers contourBuffers;
+        while (masks.popWait(item, cancelled) && !item.last) {
+            BlobsItem blobsItem;
+            blobsItem.skipped = item.skipped;
+            if (!item.quiet) {
+                try {
+                    extractBlobs(item.mask, item.frameSize, blobsItem.blobs, params, contourBuffers);
+                } catch (cv::Exception &e) {
+                    std::cout << e.msg;
+                    std::cout << "That's all Folks!" << std::endl;
+                    break;
+                }
+                freeMasks.push(std::move(item.mask));
+            }
+            if (!detections.pushWait(std::move(blobsItem), cancelled)) {
+                return;
+            }
+        }
+        BlobsItem last;
+        last.skipped = item.last ? item.skipped : 0;
+        last.last = true;
+        detections.pushWait(std::move(last), cancelled);
+    });
+
+    //Matching and logging depend on the previous frame's tracks, so they stay serial on this thread
+    int processed = 0;
+    std::exception_ptr error;
+    try {
+        BlobsItem item;
+        while (detections.popWait(item, cancelled)) {
+            for (int i = 0; i < item.skipped; i++) {
+                extrapolateTracks(tracks, params);
+                onFrame(tracks);
+                processed++;
+            }
+            if (item.last) {
+                break;
+            }
+            VC_OBSERVE(FrameQueue, frames.size());
+            VC_OBSERVE(MaskQueue, masks.size());
+            VC_OBSERVE(BlobQueue, detections.size());
+            matchCurrentFrameBlobsToExistingBlobs(tracks, item.blobs, params);
+            onFrame(tracks);
+            processed++;
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    stopDecoding = true;
+    cancelled = true;
+    decoder.join();
+    preprocessor.join();
+    extractor.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return processed;
+}
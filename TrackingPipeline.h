@@ -0,0 +1,13 @@
+#ifndef TRACKING_PIPELINE_H
+#define TRACKING_PIPELINE_H
+
+#include "Tracking.h"
+
+// Same result as the serial loop in trackVideo, but decoding, preprocessing (gray/blur/diff/morphology)
+// and contour/blob extraction each run on their own thread, connected by bounded SPSC queues.
+// Matching and onFrame stay on the calling thread, so the tracker sees frames strictly in order.
+// Continues tracks like trackVideo; the source must already be at frame tracks.frame.
+int trackVideoPipelined(FrameSource &source, const TrackingParams &params, const FrameCallback &onFrame,
+                        TrackerState &tracks);
+
+#endif    // TRACKING_PIPELINE_H
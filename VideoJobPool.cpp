@@ -0,0 +1,196 @@
+#include "VideoJobPool.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <sys/stat.h>
+
+
+VideoJobPool::VideoJobPool(const BatchOptions &options, int workers)
+        : options(options), workers(std::max(1, workers)), stats(std::max(1, workers)) {
+}
+
+
+bool VideoJobPool::run(const std::vector<std::string> &paths) {
+    jobs = &paths;
+    nextJob = 0;
+    finishedJobs = 0;
+    failed = false;
+
+    //Parallelism comes from the videos (and segments), so keep OpenCV from spawning its own threads in every worker
+    if (workers > 1 || options.segments.segments > 1) {
+        cv::setNumThreads(1);
+    }
+    if (workers == 1) {
+        worker(0);
+        return !failed;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back(&VideoJobPool::worker, this, i);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return !failed;
+}
+
+
+void VideoJobPool::worker(int index) {
+    WorkerStats &workerStats = stats[index];
+    cv::VideoCapture videoCapture;
+    std::unique_ptr<pqxx::connection> connection;
+
+    for (size_t job = nextJob++; job < jobs->size(); job = nextJob++) {
+        const std::string &path = (*jobs)[job];
+        auto start = std::chrono::steady_clock::now();
+        LogRunStats runStats = logVideo(path, videoCapture, connection);
+        workerStats.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t finished = ++finishedJobs;
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "[" << finished << "/" << jobs->size() << "] ";
+        if (!runStats.ok) {
+            workerStats.failed++;
+            failed = true;
+            std::cout << path << ": logging failed" << std::endl;
+            continue;
+        }
+        workerStats.videos++;
+        workerStats.frames += runStats.frames;
+        if (runStats.finishedBefore) {
+            std::cout << path << ": finished by an earlier run, skipped" << std::endl;
+            continue;
+        }
+        if (runStats.resumedFrom > 0) {
+            std::cout << path << ": resumed after frame " << runStats.resumedFrom << ", ";
+        } else {
+            std::cout << path << ": ";
+        }
+        std::cout << runStats.frames << " frames in " << runStats.seconds << " s ("
+                  << (runStats.seconds > 0 ? runStats.frames / runStats.seconds : 0.0) << " frames/s)";
+        if (runStats.rows > 0) {
+            std::cout << ", " << runStats.rows << " rows ("
+                      << (runStats.seconds > 0 ? runStats.rows / runStats.seconds : 0.0) << " rows/s)";
+        }
+        std::cout << std::endl;
+        if (options.stream.enabled) {
+            printStreamStats(runStats.stream);
+        }
+        std::cout << runStats.counts;
+        std::cout << runStats.segments;
+    }
+    videoCapture.release();
+}
+
+
+LogRunStats VideoJobPool::logVideo(const std::string &path, cv::VideoCapture &videoCapture,
+                                   std::unique_ptr<pqxx::connection> &connection) {
+    LogRunStats runStats;
+    videoCapture.open(path);
+    if (!videoCapture.isOpened()) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << path << ": cannot open the video" << std::endl;
+        return runStats;
+    }
+    //Live sources report no frame count
+    if (!options.stream.enabled && videoCapture.get(CV_CAP_PROP_FRAME_COUNT) < 2) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << path << ": cannot track anything on a \"video\" with less than two frames" << std::endl;
+        return runStats;
+    }
+
+    //One decoding and tracking pass feeds every requested format
+    std::string name = logNameFromPath(path);
+    CheckpointOptions checkpoint;
+    if (options.checkpointSeconds > 0) {
+        mkdir(options.outputDir.c_str(), S_IRWXU);
+        checkpoint.path = options.outputDir + "/" + name + CHECKPOINT_EXT;
+        checkpoint.video = path + " " + std::to_string((long)videoCapture.get(CV_CAP_PROP_FRAME_COUNT));
+        checkpoint.intervalSeconds = options.checkpointSeconds;
+        checkpoint.resume = options.resume;
+    }
+    //Checked before any sink is made, so the complete logs are not touched
+    if (checkpoint.resume && isFinishedCheckpoint(checkpoint.path, checkpoint.video)) {
+        runStats.ok = true;
+        runStats.finishedBefore = true;
+        return runStats;
+    }
+    std::vector<std::unique_ptr<TrackSink>> sinks;
+    std::string tableName;
+    for (int code : options.logTypeCodes) {
+        if (logTypes[code] != DB) {
+            mkdir(options.outputDir.c_str(), S_IRWXU);
+            sinks.push_back(makeFileSink(code, options.outputDir + "/" + name + logTypes[code]));
+            continue;
+        }
+        //Each worker keeps one connection for all of its videos
+        try {
+            if (!connection) {
+                connection.reset(new pqxx::connection(options.dbConnection));
+            }
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cerr << e.what() << std::endl;
+            return runStats;
+        }
+        tableName = tableNameFromLogName(name);
+        sinks.emplace_back(new DbSink(*connection, tableName, options.db));
+    }
+    if (options.nullSink) {
+        sinks.emplace_back(new NullSink());
+    }
+    CountSink *counts = nullptr;
+    if (!options.params.countLines.empty()) {
+        mkdir(options.outputDir.c_str(), S_IRWXU);
+        counts = new CountSink(options.outputDir + "/" + name + COUNTS_EXT, options.params.countLines,
+                               options.countBucketSeconds, videoCapture.get(CV_CAP_PROP_FPS));
+        sinks.emplace_back(counts);
+    }
+
+    std::vector<TrackSink *> sinkPointers;
+    for (const auto &sink : sinks) {
+        sinkPointers.push_back(sink.get());
+    }
+    if (options.segments.segments > 1) {
+        runStats = logTracksSegmented(path, sinkPointers, options.params, options.segments, options.decoder);
+    } else {
+        std::unique_ptr<FrameSource> source;
+        if (options.decoder.luma) {
+            source = openLumaSource(path, options.decoder.threads);
+            if (!source) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cerr << path << ": " << (lumaDecoderAvailable() ? "no luma plane in this video"
+                                                                     : "built without FFmpeg (VC_FFMPEG)")
+                          << ", decoding with VideoCapture" << std::endl;
+            }
+        }
+        runStats = logTracks(videoCapture, sinkPointers, options.params, options.stream, checkpoint, source.get());
+    }
+    if (counts) {
+        runStats.counts = counts->summary();
+    }
+    if (runStats.ok && !tableName.empty()) {
+        std::lock_guard<std::mutex> lock(dbtablesMutex);
+        registerLoggedTable(videoFileName(path), tableName);
+    }
+    return runStats;
+}
+
+
+void VideoJobPool::printWorkerStats() const {
+    long totalFrames = 0;
+    int totalVideos = 0;
+    double totalBusy = 0.0;
+    for (unsigned int i = 0; i < stats.size(); i++) {
+        const WorkerStats &s = stats[i];
+        std::cout << "worker " << i << ": " << s.videos << " videos, " << s.failed << " failed, "
+                  << s.frames << " frames, busy " << s.busySeconds << " s ("
+                  << (s.busySeconds > 0 ? s.frames / s.busySeconds : 0.0) << " frames/s)" << std::endl;
+        totalFrames += s.frames;
+        totalVideos += s.videos;
+        totalBusy += s.busySeconds;
+    }
+    std::cout << "Logged " << totalVideos << " videos, " << totalFrames << " frames, "
+              << totalBusy << " worker-seconds" << std::endl;
+}
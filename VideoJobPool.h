@@ -0,0 +1,46 @@
+#ifndef VIDEO_JOB_POOL_H
+#define VIDEO_JOB_POOL_H
+
+#include "BatchMode.h"
+#include "VideoLog.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct WorkerStats {
+    int videos = 0;
+    int failed = 0;
+    long frames = 0;
+    double busySeconds = 0.0;
+};
+
+// Spreads a queue of videos over N worker threads. Every worker owns its VideoCapture,
+// tracker state (inside readVideoLogTo*) and output sink, so each log is the same as in a serial run.
+class VideoJobPool {
+public:
+    VideoJobPool(const BatchOptions &options, int workers);
+
+    // Logs every path; returns false if any of them failed.
+    bool run(const std::vector<std::string> &paths);
+    const std::vector<WorkerStats> &workerStats() const { return stats; }
+    void printWorkerStats() const;
+
+private:
+    void worker(int index);
+    LogRunStats logVideo(const std::string &path, cv::VideoCapture &videoCapture,
+                         std::unique_ptr<pqxx::connection> &connection);
+
+    const BatchOptions &options;
+    int workers;
+    const std::vector<std::string> *jobs = nullptr;
+    std::atomic<size_t> nextJob{0};
+    std::atomic<size_t> finishedJobs{0};
+    std::atomic<bool> failed{false};
+    std::vector<WorkerStats> stats;
+    std::mutex outputMutex;
+    std::mutex dbtablesMutex;
+};
+
+#endif    // VIDEO_JOB_POOL_H
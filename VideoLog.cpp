@@ -0,0 +1,208 @@
+#include "VideoLog.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+
+
+LogRunStats logTracks(cv::VideoCapture &videoCapture, const std::vector<TrackSink *> &sinks,
+                      const TrackingParams &params, const StreamOptions &stream,
+                      const CheckpointOptions &checkpoint, FrameSource *source) {
+    LogRunStats stats;
+    try {
+        bool checkpoints = !checkpoint.path.empty() && !stream.enabled;
+        TrackerState resumed;
+        std::vector<std::string> sinkStates;
+        bool resuming = checkpoints && checkpoint.resume &&
+                        loadCheckpoint(checkpoint.path, checkpoint.video, resumed, sinkStates) &&
+                        sinkStates.size() == sinks.size();
+        for (size_t i = 0; i < sinks.size(); i++) {
+            if (resuming ? !sinks[i]->resume(sinkStates[i]) : !sinks[i]->open()) {
+                std::cerr << "Cannot " << (resuming ? "resume " : "open ") << sinks[i]->name() << std::endl;
+                return stats;
+            }
+        }
+        if (resuming) {
+            stats.resumedFrom = resumed.frame;
+        } else {
+            resumed = TrackerState();
+            //The logs were just opened again, so an earlier checkpoint no longer describes them
+            if (checkpoints) {
+                std::remove(checkpoint.path.c_str());
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        AsyncTrackWriter writer(sinks);
+        if (stream.enabled) {
+            stats.frames = trackStream(videoCapture, params, stream, [&](TrackerState &tracks,
+                                                                         const StreamFrameInfo &info) {
+                writer.add((int)info.sequence, tracks, info.captureTimeMs);
+            }, stats.stream);
+        } else {
+            //Log frame numbers are tracks.frame, so a resumed run goes on numbering where it stopped. It reads
+            //the checkpoint's frame again to prime the detector, so with a stride only tracked frames are saved
+            auto lastCheckpoint = std::chrono::steady_clock::now();
+            const int stride = std::max(1, params.frameStride);
+            CaptureSource captureSource(videoCapture);
+            stats.frames = trackVideo(source ? *source : captureSource, params, [&](TrackerState &tracks) {
+                writer.add(tracks.frame, tracks);
+                if (checkpoints && tracks.frame % stride == 0 &&
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >=
+                        checkpoint.intervalSeconds) {
+                    if (!writer.checkpoint(sinkStates) ||
+                        !saveCheckpoint(checkpoint.path, checkpoint.video, tracks, sinkStates)) {
+                        std::cerr << "Cannot save the checkpoint " << checkpoint.path << std::endl;
+                    }
+                    lastCheckpoint = std::chrono::steady_clock::now();
+                }
+            }, resumed);
+        }
+        stats.ok = writer.finish();
+        if (stats.ok && checkpoints && !saveFinishedCheckpoint(checkpoint.path, checkpoint.video)) {
+            std::cerr << "Cannot save the checkpoint " << checkpoint.path << std::endl;
+        }
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.rows = sinks.empty() ? 0 : sinks[0]->rows();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        stats.ok = false;
+    }
+    return stats;
+}
+
+
+LogRunStats logTracksSegmented(const std::string &path, const std::vector<TrackSink *> &sinks,
+                               const TrackingParams &params, const SegmentOptions &segments,
+                               const DecoderOptions &decoder) {
+    LogRunStats stats;
+    try {
+        for (auto sink : sinks) {
+            if (!sink->open()) {
+                std::cerr << "Cannot open " << sink->name() << std::endl;
+                return stats;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        AsyncTrackWriter writer(sinks);
+        SegmentReport report;
+        stats.frames = trackVideoSegmented(path, params, segments, [&](const SinkFrame &frame) {
+            writer.add(frame);
+        }, report, decoder);
+        stats.ok = writer.finish() && stats.frames >= 0;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.rows = sinks.empty() ? 0 : sinks[0]->rows();
+        stats.segments = report.summary();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        stats.ok = false;
+    }
+    return stats;
+}
+
+
+LogRunStats readVideoLogToFile(cv::VideoCapture &videoCapture, int logTypeCode, const std::string& logName,
+                               const std::string& logDir, const TrackingParams &params) {
+    mkdir(logDir.c_str(), S_IRWXU);
+    std::unique_ptr<TrackSink> sink = makeFileSink(logTypeCode, logDir + "/" + logName + logTypes[logTypeCode]);
+    if (!sink) {
+        std::cerr << "Not a file log format: " << logTypeCode << std::endl;
+        return LogRunStats();
+    }
+    return logTracks(videoCapture, {sink.get()}, params);
+}
+
+
+LogRunStats readVideoLogToDB(cv::VideoCapture &videoCapture, pqxx::connection &C, const std::string& tableName,
+                             const TrackingParams &params, const DbLogOptions &dbOptions) {
+    DbSink sink(C, tableName, dbOptions);
+    return logTracks(videoCapture, {&sink}, params);
+}
+
+
+//Line by line comparison of two TXT logs; reports the first differences and returns how many lines differ
+long compareLogFiles(const std::string &expectedPath, const std::string &actualPath) {
+    std::ifstream expected(expectedPath), actual(actualPath);
+    if (!expected.is_open() || !actual.is_open()) {
+        std::cerr << "Cannot open " << (expected.is_open() ? actualPath : expectedPath) << std::endl;
+        return -1;
+    }
+    std::string expectedLine, actualLine;
+    long line = 0;
+    long differences = 0;
+    while (true) {
+        bool haveExpected = (bool)std::getline(expected, expectedLine);
+        bool haveActual = (bool)std::getline(actual, actualLine);
+        if (!haveExpected && !haveActual) {
+            break;
+        }
+        line++;
+        if (haveExpected != haveActual || expectedLine != actualLine) {
+            if (differences < 10) {
+                std::cout << "line " << line << ":" << std::endl
+                          << "  expected: " << (haveExpected ? expectedLine : "<end of log>") << std::endl
+                          << "  actual:   " << (haveActual ? actualLine : "<end of log>") << std::endl;
+            }
+            differences++;
+        }
+    }
+    std::cout << line << " lines compared, " << differences << " differ" << std::endl;
+    return differences;
+}
+
+
+//"some/dir/video.avi" -> "video.avi"
+std::string videoFileName(const std::string &path) {
+    if (path.find_last_of('/') == std::string::npos) {
+        return path;
+    }
+    return path.substr(path.find_last_of('/') + 1);
+}
+
+
+//"some/dir/video.avi" -> "video"
+std::string logNameFromPath(const std::string &path) {
+    std::string file = videoFileName(path);
+    return file.substr(0, file.find_last_of('.'));
+}
+
+
+//Anything but letters, digits and '_' becomes '_' (spaces always did), long names are cut to the 63 bytes
+//PostgreSQL keeps, minus room for the "_PK" constraint suffix
+std::string tableNameFromLogName(const std::string &name) {
+    std::string tableName = "TABLE_" + name;
+    std::replace_if(tableName.begin(), tableName.end(), [](char c) {
+        return !std::isalnum((unsigned char)c) && c != '_';
+    }, '_');
+    return tableName.substr(0, 60);
+}
+
+
+std::string loggedTableName(std::ifstream &f, std::string sp) {
+    std::string s, s1, s2;
+    while (getline(f, s)) {
+        std::istringstream ss(s);
+        ss >> s1 >> s2;
+        if (s1 == sp) {
+            return s2;
+        }
+    }
+    return "";
+}
+
+
+void registerLoggedTable(const std::string &videoFile, const std::string &tableName) {
+    std::ifstream dbtables("dbtables.txt");
+    if (dbtables.is_open()) {
+        std::string lname = loggedTableName(dbtables, videoFile);
+        if (lname.empty()) {
+            dbtables.close();
+            std::ofstream dbtables("dbtables.txt", std::fstream::app);
+            dbtables << videoFile << " " << tableName << std::endl;
+        }
+    }
+    dbtables.close();
+}
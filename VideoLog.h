@@ -0,0 +1,81 @@
+#ifndef VIDEO_LOG_H
+#define VIDEO_LOG_H
+
+#include "Blob.h"
+#include "Tracking.h"
+#include "DbLog.h"
+#include "TrackSink.h"
+#include "StreamIngest.h"
+#include "Checkpoint.h"
+#include "SegmentTracking.h"
+#include "FrameSource.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+const std::string TXT_EXT = ".txt";
+const std::string XML_EXT = ".xml";
+const std::string BIN_EXT = ".vclog";
+const std::string CSV_EXT = ".csv";
+const std::string JSONL_EXT = ".jsonl";
+const std::string DB = "database";
+// Count line aggregates (CountSink), written next to the logs whenever count lines are set
+const std::string COUNTS_EXT = ".counts.csv";
+// Progress of an unfinished run (Checkpoint.h), next to the logs
+const std::string CHECKPOINT_EXT = ".checkpoint";
+// File formats first, the database last (the player relies on this order)
+const std::string logTypes[] = {"", TXT_EXT, BIN_EXT, CSV_EXT, JSONL_EXT, DB};
+const int TYPES_NUMBER = (sizeof(logTypes)/sizeof(*logTypes)) - 1;
+
+const std::string DEFAULT_LOG_DIR = "tracking_logs";
+const std::string DB_CONNECTION =
+        "dbname = vehicle_counter_db user = vehicle_counter password = vc12345 hostaddr=127.0.0.1 port=5432";
+
+// Outcome of logging one video: whether it succeeded and how many frame pairs were tracked in how long.
+struct LogRunStats {
+    bool ok = false;
+    int frames = 0;
+    int resumedFrom = 0;    // frame of the checkpoint the run continued from, 0 if it started at frame 1
+    bool finishedBefore = false;    // --resume: logged to the end by an earlier run, not tracked again
+    double seconds = 0.0;
+    long rows = 0;          // track boxes logged
+    StreamStats stream;     // filled for streams only
+    std::string counts;     // count line totals (CountSink::summary) if count lines were set
+    std::string segments;   // SegmentReport::summary of a segmented run
+};
+
+// Tracks the video once and feeds every frame to all sinks through an AsyncTrackWriter. Opens the sinks
+// first and fails without tracking if any of them cannot be opened. With stream.enabled the source is
+// tracked by trackStream: frames are numbered in capture order and carry their capture time.
+// With checkpoint.path set (files only), progress is saved every checkpoint.intervalSeconds and marked
+// finished when the run succeeds (saveFinishedCheckpoint); with checkpoint.resume a saved checkpoint is
+// continued, the sinks are resumed instead of opened. A file is read from source instead of videoCapture
+// if one is given (openLumaSource).
+LogRunStats logTracks(cv::VideoCapture &videoCapture, const std::vector<TrackSink *> &sinks,
+                      const TrackingParams &params = TrackingParams(),
+                      const StreamOptions &stream = StreamOptions(),
+                      const CheckpointOptions &checkpoint = CheckpointOptions(),
+                      FrameSource *source = nullptr);
+
+// Like logTracks, but the video at path is tracked in time segments at once by trackVideoSegmented. No
+// checkpoints, no streams.
+LogRunStats logTracksSegmented(const std::string &path, const std::vector<TrackSink *> &sinks,
+                               const TrackingParams &params, const SegmentOptions &segments,
+                               const DecoderOptions &decoder = DecoderOptions());
+
+LogRunStats readVideoLogToFile(cv::VideoCapture &videoCapture, int logTypeCode, const std::string& logName,
+                               const std::string& logDir = DEFAULT_LOG_DIR,
+                               const TrackingParams &params = TrackingParams());
+LogRunStats readVideoLogToDB(cv::VideoCapture &videoCapture, pqxx::connection &C, const std::string& tableName,
+                             const TrackingParams &params = TrackingParams(),
+                             const DbLogOptions &dbOptions = DbLogOptions());
+long compareLogFiles(const std::string &expectedPath, const std::string &actualPath);
+
+std::string videoFileName(const std::string &path);
+std::string logNameFromPath(const std::string &path);
+std::string tableNameFromLogName(const std::string &name);
+std::string loggedTableName(std::ifstream &f, std::string s);
+void registerLoggedTable(const std::string &videoFile, const std::string &tableName);
+
+#endif    // VIDEO_LOG_H
@@ -0,0 +1,107 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+//Worker index of the calling thread within currentPool, -1 outside of any pool
+static thread_local const WorkStealingPool *currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+
+WorkStealingPool::WorkStealingPool(int threads, int levels)
+        : levels(std::max(1, levels)), levelCounts(new std::atomic<long>[std::max(1, levels)]) {
+    for (int level = 0; level < this->levels; level++) {
+        levelCounts[level] = 0;
+    }
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(new Worker());
+        workers.back()->queues.resize(this->levels);
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+}
+
+
+void WorkStealingPool::submit(int level, size_t home, Task task) {
+    level = std::min(std::max(level, 0), levels - 1);
+    int index = currentPool == this ? currentWorker : (int)(home % workers.size());
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->queues[level].push_back(std::move(task));
+    }
+    levelCounts[level]++;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks++;
+    }
+    wake.notify_one();
+}
+
+
+long WorkStealingPool::queued(int level) const {
+    return level >= 0 && level < levels ? levelCounts[level].load() : 0;
+}
+
+
+bool WorkStealingPool::take(int index, Task &task) {
+    const int count = (int)workers.size();
+    for (int level = 0; level < levels; level++) {
+        if (levelCounts[level] == 0) {
+            continue;
+        }
+        for (int offset = 0; offset < count; offset++) {
+            Worker &worker = *workers[(index + offset) % count];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            std::deque<Task> &queue = worker.queues[level];
+            if (queue.empty()) {
+                continue;
+            }
+            //Own tasks oldest first, stolen ones newest first, so the owner and the thief work from both ends
+            if (offset == 0) {
+                task = std::move(queue.front());
+                queue.pop_front();
+            } else {
+                task = std::move(queue.back());
+                queue.pop_back();
+                steals++;
+            }
+            levelCounts[level]--;
+            queuedTasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void WorkStealingPool::run(int index) {
+    currentPool = this;
+    currentWorker = index;
+    Task task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return queuedTasks > 0 || stopping; });
+        if (queuedTasks == 0 && stopping) {
+            break;
+        }
+    }
+    currentPool = nullptr;
+    currentWorker = -1;
+}
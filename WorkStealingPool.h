@@ -0,0 +1,58 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running short tasks at a few priority levels (0 runs first). Every worker has
+// a deque per level: it runs its own tasks oldest first and, when it has none left at a level, steals the
+// newest task of that level from another worker before it looks at a lower level. So a higher level is
+// always emptied first pool-wide, and a task submitted again from a running task stays on the same worker
+// (its data stays in that core's cache) unless another worker is idle.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    WorkStealingPool(int threads, int levels);
+    // Runs the tasks still queued, then joins the workers
+    ~WorkStealingPool();
+
+    // Queues task at level. From a task of this pool it goes to the running worker's own deque, from any
+    // other thread to worker home % threads.
+    void submit(int level, size_t home, Task task);
+
+    int threads() const { return (int)workers.size(); }
+    // Tasks queued at level, not counting running ones
+    long queued(int level) const;
+    // Tasks run by another worker than the one they were queued on
+    long stolen() const { return steals; }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::vector<std::deque<Task>> queues;
+        std::thread thread;
+    };
+
+    bool take(int index, Task &task);
+    void run(int index);
+
+    int levels;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unique_ptr<std::atomic<long>[]> levelCounts;
+    std::atomic<long> steals{0};
+
+    //queuedTasks only grows under sleepMutex, so a worker checking it there cannot miss a wake-up
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<long> queuedTasks{0};
+    bool stopping = false;
+};
+
+#endif    // WORK_STEALING_POOL_H
@@ -0,0 +1,991 @@
+#include "Tracking.h"
+#include "FrameDiffer.h"
+#include "BackgroundModel.h"
+#include "VideoLog.h"
+#include "BinaryLog.h"
+#include "DbLog.h"
+#include "TrackSink.h"
+#include "SyntheticTraffic.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/highgui/highgui.hpp>
+
+//Every operator new in the process, including the ones inside OpenCV's filters
+static std::atomic<long> heapAllocations{0};
+
+void *operator new(size_t size) {
+    heapAllocations++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+
+//Counts image buffers handed out to cv::Mat, then lets the standard allocator do the work
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, int flags,
+                           cv::UMatUsageFlags usageFlags) const override {
+        allocations++;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+
+    mutable std::atomic<long> allocations{0};
+};
+
+static CountingMatAllocator matAllocator;
+
+
+//Scene and length of the pipeline benchmark, set from the command line
+struct BenchConfig {
+    TrafficParams traffic;
+    int frames = 600;
+    std::string jsonPath;
+    std::string videoPath;
+};
+
+static BenchConfig benchConfig;
+
+
+//Every number a benchmark prints, for the --json report
+struct BenchRecord {
+    std::string benchmark;
+    std::string name;
+    std::vector<std::pair<std::string, double>> values;
+};
+
+static std::vector<BenchRecord> benchRecords;
+static std::string currentBenchmark;
+
+static void record(std::string name, const std::vector<std::pair<std::string, double>> &values) {
+    name.erase(name.find_last_not_of(' ') + 1);
+    benchRecords.push_back({currentBenchmark, name, values});
+}
+
+
+//Noisy background with a few bright rectangles moving to the right
+static std::vector<cv::Mat> syntheticFrames(int width, int height, int count) {
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < count; i++) {
+        cv::Mat frame(height, width, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(40), cv::Scalar::all(80));
+        for (int car = 0; car < 3; car++) {
+            int x = (i * 12 + car * width / 3) % width;
+            int y = height / 4 + car * height / 6;
+            cv::rectangle(frame, cv::Rect(x, y, width / 6, height / 8), cv::Scalar(200, 200, 200), -1);
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+
+struct StageResult {
+    double msPerFrame;
+    double matAllocationsPerFrame;
+    double heapAllocationsPerFrame;
+};
+
+//Runs step over all frames twice (warm-up, then measured)
+static StageResult measure(const std::vector<cv::Mat> &frames, const std::function<void(const cv::Mat &)> &step) {
+    for (const auto &frame : frames) {
+        step(frame);
+    }
+    long matBefore = matAllocator.allocations;
+    long heapBefore = heapAllocations;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &frame : frames) {
+        step(frame);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double n = frames.size();
+    return {seconds * 1000.0 / n, (matAllocator.allocations - matBefore) / n, (heapAllocations - heapBefore) / n};
+}
+
+
+static void printResult(const std::string &name, const StageResult &result) {
+    record(name, {{"ms_per_frame", result.msPerFrame},
+                  {"image_buffers_per_frame", result.matAllocationsPerFrame},
+                  {"operator_new_per_frame", result.heapAllocationsPerFrame}});
+    std::cout << name << ": " << result.msPerFrame << " ms/frame, "
+              << result.matAllocationsPerFrame << " image buffers/frame, "
+              << result.heapAllocationsPerFrame << " operator new/frame" << std::endl;
+}
+
+
+//Old loop (preprocessFrames on both frames + prevFrame = curFrame.clone()) against FrameDiffer
+static void benchFrameDiffer() {
+    std::vector<cv::Mat> frames = syntheticFrames(1920, 1080, 60);
+    TrackingParams params;
+
+    cv::Mat prevFrame = frames.back().clone();
+    StageResult legacy = measure(frames, [&](const cv::Mat &frame) {
+        cv::Mat curFrame = frame;
+        cv::Mat mask = preprocessFrames(prevFrame, curFrame, params);
+        prevFrame = curFrame.clone();
+    });
+
+    FrameDiffer differ(params);
+    StageResult engine = measure(frames, [&](const cv::Mat &frame) {
+        differ.apply(frame);
+    });
+
+    std::cout << "== frame differencing, 1920x1080" << std::endl;
+    printResult("preprocessFrames", legacy);
+    printResult("FrameDiffer", engine);
+    std::cout << "saved " << legacy.msPerFrame - engine.msPerFrame << " ms/frame" << std::endl;
+}
+
+
+//OpenCV calls against the fused kernel, with a check that both give the same mask
+static void benchFused() {
+    const cv::Size sizes[] = {cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(3840, 2160)};
+    for (const auto &size : sizes) {
+        std::vector<cv::Mat> frames = syntheticFrames(size.width, size.height, 30);
+        TrackingParams params;
+        TrackingParams fusedParams;
+        fusedParams.fusedPreprocessing = true;
+
+        FrameDiffer opencv(params);
+        FrameDiffer fused(fusedParams);
+        StageResult opencvResult = measure(frames, [&](const cv::Mat &frame) { opencv.apply(frame); });
+        StageResult fusedResult = measure(frames, [&](const cv::Mat &frame) { fused.apply(frame); });
+
+        cv::Mat mismatch;
+        cv::compare(opencv.mask(), fused.mask(), mismatch, cv::CMP_NE);
+        std::cout << "== fused preprocessing (" << FusedPreprocessor::instructionSet() << "), "
+                  << size.width << "x" << size.height << std::endl;
+        std::string dimensions = std::to_string(size.width) + "x" + std::to_string(size.height);
+        printResult("OpenCV " + dimensions, opencvResult);
+        printResult("fused " + dimensions, fusedResult);
+        std::cout << "speedup " << opencvResult.msPerFrame / fusedResult.msPerFrame << "x, masks "
+                  << (cv::countNonZero(mismatch) == 0 ? "identical" : "DIFFER") << std::endl;
+    }
+}
+
+
+//What --roi and --scale save on a 4K camera; the polygon covers the lanes the synthetic cars drive on
+static void benchRegion() {
+    std::vector<cv::Mat> frames = syntheticFrames(3840, 2160, 30);
+    struct Setting {
+        std::string name;
+        bool roi;
+        double scale;
+    };
+    const Setting settings[] = {{"full frame", false, 1.0}, {"lane ROI  ", true, 1.0},
+                                {"scale 1/2 ", false, 0.5}, {"scale 1/4 ", false, 0.25},
+                                {"ROI + 1/4 ", true, 0.25}};
+    std::cout << "== region of interest and scale, 3840x2160" << std::endl;
+    for (const auto &setting : settings) {
+        TrackingParams params;
+        params.processingScale = setting.scale;
+        if (setting.roi) {
+            params.roi = {cv::Point(0, 500), cv::Point(3840, 500), cv::Point(3840, 1500), cv::Point(0, 1500)};
+        }
+        FrameDiffer differ(params);
+        size_t blobs = 0;
+        std::vector<Blob> curFrameBlobs;
+        ContourBuffers contourBuffers;
+        StageResult result = measure(frames, [&](const cv::Mat &frame) {
+            if (differ.apply(frame)) {
+                curFrameBlobs.clear();
+                extractBlobs(differ.mask(), frame.size(), curFrameBlobs, params, contourBuffers);
+                blobs += curFrameBlobs.size();
+            }
+        });
+        printResult(setting.name, result);
+        //measure() runs every frame twice
+        std::cout << "           " << blobs / (2.0 * frames.size()) << " detections/frame" << std::endl;
+    }
+}
+
+
+//A long highway recording in miniature: cars enter on four lanes, drive across and leave, so the number
+//of tracks ever seen keeps growing while the number on screen stays small
+static void benchMatching() {
+    const int frames = 20000;
+    const int window = 1000;
+    struct Setting {
+        std::string name;
+        MatchMode mode;
+        int countLines;
+    };
+    const Setting settings[] = {{"nearest", MatchMode::Nearest, 0}, {"greedy", MatchMode::Greedy, 0},
+                                {"nearest, 8 count lines", MatchMode::Nearest, 8}};
+    for (const auto &setting : settings) {
+        TrackingParams params;
+        params.matchMode = setting.mode;
+        for (int i = 0; i < setting.countLines; i++) {
+            params.countLines.push_back({"line" + std::to_string(i), cv::Point(200 + i * 200, 0),
+                                         cv::Point(200 + i * 200, 1100), 4});
+        }
+        TrackerState tracks;
+        double firstSeconds = 0.0, lastSeconds = 0.0;
+
+        for (int frame = 0; frame < frames; frame++) {
+            std::vector<Blob> curFrameBlobs;
+            for (int lane = 0; lane < 4; lane++) {
+                for (int car = frame % 40 + lane * 10; car < 200; car += 40) {
+                    int x = car * 10 - 200, y = 200 + lane * 220;
+                    curFrameBlobs.emplace_back(std::vector<cv::Point>{
+                            cv::Point(x, y), cv::Point(x + 300, y), cv::Point(x + 300, y + 150), cv::Point(x, y + 150)});
+                }
+            }
+            auto start = std::chrono::steady_clock::now();
+            matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (frame < window) {
+                firstSeconds += seconds;
+            } else if (frame >= frames - window) {
+                lastSeconds += seconds;
+            }
+        }
+
+        long counted = 0;
+        for (const auto &counter : tracks.lineCounts) {
+            for (size_t lane = 0; lane < counter.forward.size(); lane++) {
+                counted += counter.forward[lane] + counter.backward[lane];
+            }
+        }
+        std::cout << "== matching (" << setting.name << "), "
+                  << tracks.nextId << " tracks after " << frames << " frames, " << tracks.blobs.size() << " live, "
+                  << tracks.archive.size() << " archived, " << counted << " line crossings" << std::endl;
+        record(setting.name, {{"tracks", (double)tracks.nextId}, {"line_crossings", (double)counted},
+                              {"first_ms_per_frame", firstSeconds * 1000.0 / window},
+                              {"last_ms_per_frame", lastSeconds * 1000.0 / window}});
+        std::cout << "first " << window << " frames: " << firstSeconds * 1000.0 / window << " ms/frame, last "
+                  << window << " frames: " << lastSeconds * 1000.0 / window << " ms/frame" << std::endl;
+    }
+}
+
+
+static long fileSize(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file.is_open() ? (long)file.tellg() : -1;
+}
+
+
+//1000 frames of tracker state (0 to 3 live tracks per frame) that the log writers cycle through
+static std::vector<TrackerState> syntheticTracks() {
+    std::vector<TrackerState> tracks;
+    for (int frame = 0; frame < 1000; frame++) {
+        TrackerState state;
+        for (int track = 0; track < frame % 4; track++) {
+            int x = 100 + (frame * 7 + track * 400) % 1500, y = 300 + track * 150;
+            state.blobs.emplace_back(std::vector<cv::Point>{cv::Point(x, y), cv::Point(x + 280, y + 140)});
+            state.blobs.back().intId = frame / 4 + track;
+        }
+        tracks.push_back(state);
+    }
+    return tracks;
+}
+
+
+//Time the tracker spends in AsyncTrackWriter::add (what logging costs frame processing) and the total
+//time until every sink is finished
+static double benchSinks(const std::string &name, const std::vector<TrackSink *> &sinks,
+                       const std::vector<TrackerState> &tracks, int frames) {
+    for (auto sink : sinks) {
+        sink->open();
+    }
+    auto start = std::chrono::steady_clock::now();
+    AsyncTrackWriter writer(sinks);
+    for (int frame = 0; frame < frames; frame++) {
+        writer.add(frame + 1, tracks[frame % tracks.size()]);
+    }
+    double adding = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    writer.finish();
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    record(name, {{"blocked_ms", adding * 1000.0}, {"written_ms", total * 1000.0}});
+    std::cout << name << ": tracker blocked " << adding * 1000.0 << " ms, written after " << total * 1000.0
+              << " ms" << std::endl;
+    return total;
+}
+
+
+//Same tracks written through every file sink, then the TXT log and the .vclog read back the way the player reads them
+static void benchLogFormats() {
+    const int frames = 200000;
+    const std::string txtPath = "/tmp/vehicle_counter_bench.txt";
+    const std::string binaryPath = "/tmp/vehicle_counter_bench.vclog";
+    const std::string csvPath = "/tmp/vehicle_counter_bench.csv";
+    const std::string jsonPath = "/tmp/vehicle_counter_bench.jsonl";
+    std::vector<TrackerState> tracks = syntheticTracks();
+
+    std::cout << "== log formats, " << frames << " frames" << std::endl;
+    {
+        NullSink null;
+        benchSinks("null  ", {&null}, tracks, frames);
+        CsvSink csv(csvPath);
+        benchSinks("csv   ", {&csv}, tracks, frames);
+        JsonLinesSink json(jsonPath);
+        benchSinks("jsonl ", {&json}, tracks, frames);
+        TxtSink txt(txtPath);
+        BinarySink binary(binaryPath);
+        benchSinks("txt+vclog+csv+jsonl", {&txt, &binary, &csv, &json}, tracks, frames);
+    }
+    TxtSink txt(txtPath);
+    double txtWrite = benchSinks("txt   ", {&txt}, tracks, frames);
+    BinarySink binary(binaryPath);
+    double binaryWrite = benchSinks("vclog ", {&binary}, tracks, frames);
+
+    long txtSum = 0, binarySum = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream txtIn(txtPath);
+    std::string line;
+    while (std::getline(txtIn, line)) {
+        std::istringstream ss(line);
+        int frameNumber, blob, x, y, width, height;
+        ss >> frameNumber;
+        while (ss >> blob >> x >> y >> width >> height) {
+            txtSum += x + y + width + height;
+        }
+    }
+    double txtRead = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    BinaryLogReader reader;
+    reader.open(binaryPath);
+    for (int frame = 1; frame <= reader.frames(); frame++) {
+        for (auto record = reader.begin(frame); record != reader.end(frame); ++record) {
+            binarySum += record->x + record->y + record->width + record->height;
+        }
+    }
+    double binaryRead = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    record("txt file", {{"bytes", (double)fileSize(txtPath)}, {"write_ms", txtWrite * 1000.0},
+                        {"read_ms", txtRead * 1000.0}});
+    record("vclog file", {{"bytes", (double)fileSize(binaryPath)}, {"write_ms", binaryWrite * 1000.0},
+                          {"read_ms", binaryRead * 1000.0}});
+    std::cout << "txt:   " << fileSize(txtPath) << " bytes, write " << txtWrite * 1000.0 << " ms, read "
+              << txtRead * 1000.0 << " ms" << std::endl;
+    std::cout << "vclog: " << fileSize(binaryPath) << " bytes, write " << binaryWrite * 1000.0 << " ms, read "
+              << binaryRead * 1000.0 << " ms" << std::endl;
+    std::cout << "contents " << (txtSum == binarySum ? "identical" : "DIFFER") << std::endl;
+    std::remove(txtPath.c_str());
+    std::remove(binaryPath.c_str());
+    std::remove(csvPath.c_str());
+    std::remove(jsonPath.c_str());
+}
+
+
+//Needs a scratch PostgreSQL database: VC_BENCH_DB="dbname=... user=..." VehicleCounter_bench db
+static void benchDatabase() {
+    const char *connection = std::getenv("VC_BENCH_DB");
+    if (!connection) {
+        std::cout << "== database: set VC_BENCH_DB to a connection string to run it" << std::endl;
+        return;
+    }
+    const int frames = 20000;
+    const std::string tableName = "TABLE_vehicle_counter_bench";
+    std::vector<TrackerState> tracks = syntheticTracks();
+    pqxx::connection C(connection);
+
+    auto run = [&](const std::string &name, const std::function<long(pqxx::work &)> &write) {
+        pqxx::work W(C);
+        W.exec("DROP TABLE IF EXISTS " + tableName + ";");
+        W.exec("CREATE TABLE " + tableName + "(FRAME_ID INT NOT NULL, BLOB_ID INT NOT NULL, X INT NOT NULL, "
+               "Y INT NOT NULL, WIDTH INT NOT NULL, HEIGHT INT NOT NULL);");
+        auto start = std::chrono::steady_clock::now();
+        long rows = write(W);
+        W.commit();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        record(name, {{"rows", (double)rows}, {"seconds", seconds}});
+        std::cout << name << ": " << rows << " rows in " << seconds << " s (" << rows / seconds << " rows/s)" << std::endl;
+    };
+
+    std::cout << "== database, " << frames << " frames" << std::endl;
+    run("INSERT per row", [&](pqxx::work &W) {
+        long rows = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            for (const auto &blob : tracks[frame % tracks.size()].blobs) {
+                const cv::Rect &rect = blob.currentBoundingRect;
+                W.exec("INSERT INTO " + tableName + " VALUES (" + std::to_string(frame + 1) + ", " +
+                       std::to_string(blob.intId) + ", " + std::to_string(rect.x) + ", " + std::to_string(rect.y) +
+                       ", " + std::to_string(rect.width) + ", " + std::to_string(rect.height) + ");");
+                rows++;
+            }
+        }
+        return rows;
+    });
+    for (bool useCopy : {false, true}) {
+        DbLogOptions options;
+        options.useCopy = useCopy;
+        run(useCopy ? "COPY, 100 frames/batch" : "INSERT, 100 frames/batch", [&](pqxx::work &W) {
+            DbLogWriter writer(W, tableName, options);
+            SinkFrame sinkFrame;
+            for (int frame = 0; frame < frames; frame++) {
+                fillSinkFrame(frame + 1, tracks[frame % tracks.size()], sinkFrame);
+                writer.writeFrame(sinkFrame);
+            }
+            writer.flush();
+            return writer.rows();
+        });
+    }
+    pqxx::work W(C);
+    W.exec("DROP TABLE IF EXISTS " + tableName + ";");
+    W.commit();
+}
+
+
+//Per-frame times of one stage
+struct StageTimes {
+    std::string name;
+    std::vector<double> ms;
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1))];
+}
+
+
+//The whole tracking loop on synthetic traffic, every stage timed on its own: rendering (what decoding costs
+//for real videos), the three steps of track2Frames, copying the tracks for logging and each sink's write
+static void benchPipeline() {
+    const TrafficParams &traffic = benchConfig.traffic;
+    SyntheticTraffic scene(traffic);
+    TrackingParams params;
+    params.countLines.push_back({"middle", cv::Point(traffic.width / 2, 0),
+                                 cv::Point(traffic.width / 2, traffic.height), traffic.lanes});
+
+    const std::string prefix = "/tmp/vehicle_counter_pipeline";
+    TxtSink txt(prefix + TXT_EXT);
+    BinarySink binary(prefix + BIN_EXT);
+    CsvSink csv(prefix + CSV_EXT);
+    JsonLinesSink json(prefix + JSONL_EXT);
+    CountSink counts(prefix + COUNTS_EXT, params.countLines, 1.0, 25.0);
+    const std::vector<std::pair<std::string, TrackSink *>> sinks = {
+            {"sink txt", &txt}, {"sink vclog", &binary}, {"sink csv", &csv}, {"sink jsonl", &json},
+            {"sink counts", &counts}};
+    for (const auto &sink : sinks) {
+        sink.second->open();
+    }
+
+    std::vector<StageTimes> stages = {{"render", {}}, {"preprocess", {}}, {"extract", {}}, {"match", {}},
+                                      {"snapshot", {}}};
+    for (const auto &sink : sinks) {
+        stages.push_back({sink.first, {}});
+    }
+    auto timed = [&](size_t stage, const std::function<void()> &step) {
+        auto start = std::chrono::steady_clock::now();
+        step();
+        stages[stage].ms.push_back(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    FrameDiffer differ(params);
+    TrackerState tracks;
+    std::vector<Blob> curFrameBlobs;
+    ContourBuffers contourBuffers;
+    SinkFrame sinkFrame;
+    cv::Mat frame;
+    long detections = 0;
+    for (int n = 0; n < benchConfig.frames; n++) {
+        timed(0, [&] { scene.render(n, frame); });
+        bool primed = false;
+        timed(1, [&] { primed = differ.apply(frame); });
+        if (!primed) {
+            continue;
+        }
+        timed(2, [&] {
+            curFrameBlobs.clear();
+            extractBlobs(differ.mask(), frame.size(), curFrameBlobs, params, contourBuffers);
+        });
+        detections += curFrameBlobs.size();
+        timed(3, [&] { matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params); });
+        timed(4, [&] { fillSinkFrame(tracks.frame, tracks, sinkFrame); });
+        for (size_t i = 0; i < sinks.size(); i++) {
+            timed(5 + i, [&] { sinks[i].second->write(sinkFrame); });
+        }
+    }
+    for (const auto &sink : sinks) {
+        sink.second->finish();
+        std::remove(sink.second->name().c_str());
+    }
+
+    double trackingMs = 0.0;
+    std::cout << "== pipeline, " << benchConfig.frames << " synthetic frames " << traffic.width << "x"
+              << traffic.height << ", " << traffic.vehicles << " vehicles at " << traffic.speed << " px/frame"
+              << std::endl;
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageTimes &stage = stages[i];
+        double total = 0.0;
+        for (double ms : stage.ms) {
+            total += ms;
+        }
+        double mean = stage.ms.empty() ? 0.0 : total / stage.ms.size();
+        if (i >= 1 && i <= 3) {
+            trackingMs += mean;
+        }
+        record(stage.name, {{"mean_ms", mean}, {"p50_ms", percentile(stage.ms, 0.5)},
+                            {"p95_ms", percentile(stage.ms, 0.95)}, {"max_ms", percentile(stage.ms, 1.0)}});
+        std::cout << stage.name << ": mean " << mean << " ms, p50 " << percentile(stage.ms, 0.5) << " ms, p95 "
+                  << percentile(stage.ms, 0.95) << " ms, max " << percentile(stage.ms, 1.0) << " ms" << std::endl;
+    }
+    long tracked = stages[3].ms.size();
+    record("tracking", {{"ms_per_frame", trackingMs}, {"fps", trackingMs > 0 ? 1000.0 / trackingMs : 0.0},
+                        {"detections_per_frame", tracked > 0 ? (double)detections / tracked : 0.0},
+                        {"tracks", (double)tracks.nextId},
+                        {"vehicles", (double)scene.vehiclesEntered(benchConfig.frames)}});
+    std::cout << "tracking: " << trackingMs << " ms/frame (" << (trackingMs > 0 ? 1000.0 / trackingMs : 0.0)
+              << " fps), " << (tracked > 0 ? (double)detections / tracked : 0.0) << " detections/frame, "
+              << tracks.nextId << " tracks for " << scene.vehiclesEntered(benchConfig.frames) << " vehicles"
+              << std::endl;
+}
+
+
+//Frame differencing against the background models on the synthetic scene, and on the same scene with vehicles
+//at a sixth of the speed. Fragmentation is tracks per vehicle: 1 when every vehicle keeps one track across
+//the picture, more when it falls apart into several (with the original matching a track also ends after
+//five matched frames, so frame differencing starts well above 1).
+static void benchDetectors() {
+    TrafficParams slow = benchConfig.traffic;
+    slow.speed /= 6.0;
+    const std::pair<std::string, TrafficParams> scenes[] = {{"", benchConfig.traffic}, {" slow", slow}};
+    for (const auto &scene : scenes) {
+        SyntheticTraffic traffic(scene.second);
+        std::cout << "== detectors, " << benchConfig.frames << " synthetic frames " << scene.second.width << "x"
+                  << scene.second.height << ", vehicles at " << scene.second.speed << " px/frame" << std::endl;
+        for (DetectorMode mode : {DetectorMode::FrameDiff, DetectorMode::RunningAverage, DetectorMode::Mog2}) {
+            TrackingParams params;
+            params.detector = mode;
+            std::unique_ptr<MotionDetector> detector = createMotionDetector(params);
+            TrackerState tracks;
+            std::vector<Blob> curFrameBlobs;
+            ContourBuffers contourBuffers;
+            cv::Mat frame;
+            double detectMs = 0.0, trackingMs = 0.0;
+            long detections = 0;
+            for (int n = 0; n < benchConfig.frames; n++) {
+                traffic.render(n, frame);
+                auto start = std::chrono::steady_clock::now();
+                if (!detector->apply(frame)) {
+                    continue;
+                }
+                auto detected = std::chrono::steady_clock::now();
+                curFrameBlobs.clear();
+                extractBlobs(detector->mask(), frame.size(), curFrameBlobs, params, contourBuffers);
+                matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+                auto matched = std::chrono::steady_clock::now();
+                detectMs += std::chrono::duration<double, std::milli>(detected - start).count();
+                trackingMs += std::chrono::duration<double, std::milli>(matched - start).count();
+                detections += curFrameBlobs.size();
+            }
+
+            double frames = std::max(tracks.frame, 1);
+            int vehicles = traffic.vehiclesEntered(benchConfig.frames);
+            double fragmentation = vehicles > 0 ? (double)tracks.nextId / vehicles : 0.0;
+            double modelMb = 0.0;
+            if (auto background = dynamic_cast<BackgroundDetector *>(detector.get())) {
+                modelMb = background->modelBytes() / 1048576.0;
+            }
+            std::string name = std::string(detectorName(mode)) + scene.first;
+            record(name, {{"detect_ms_per_frame", detectMs / frames}, {"tracking_ms_per_frame", trackingMs / frames},
+                          {"fps", trackingMs > 0 ? 1000.0 * frames / trackingMs : 0.0},
+                          {"detections_per_frame", detections / frames}, {"tracks", (double)tracks.nextId},
+                          {"vehicles", (double)vehicles}, {"tracks_per_vehicle", fragmentation},
+                          {"live_tracks", (double)tracks.blobs.size()}, {"model_mb", modelMb}});
+            std::cout << name << ": detect " << detectMs / frames << " ms/frame, tracking " << trackingMs / frames
+                      << " ms/frame (" << (trackingMs > 0 ? 1000.0 * frames / trackingMs : 0.0) << " fps), "
+                      << detections / frames << " detections/frame, " << tracks.nextId << " tracks for " << vehicles
+                      << " vehicles (" << fragmentation << " per vehicle), " << tracks.blobs.size()
+                      << " live at the end, model " << modelMb << " MB" << std::endl;
+        }
+    }
+}
+
+
+static double intersectionOverUnion(const cv::Rect &a, const cv::Rect &b) {
+    double intersection = (a & b).area();
+    return intersection > 0 ? intersection / (a.area() + b.area() - intersection) : 0.0;
+}
+
+
+//--motion-gate and --stride against tracking every frame, on the synthetic scene by day and by night (the same
+//traffic for 60 of every 300 frames, the empty road otherwise). Accuracy is measured against the ground truth:
+//recall is the share of vehicles fully in the picture that have a logged box overlapping them by half (IoU),
+//precision the share of logged boxes that overlap a vehicle so, and crossings are the count line totals.
+static void benchGating() {
+    const TrafficParams &traffic = benchConfig.traffic;
+    SyntheticTraffic scene(traffic);
+    const cv::Rect frameRect(0, 0, traffic.width, traffic.height);
+    struct Setting {
+        std::string name;
+        int gate;
+        int stride;
+    };
+    const Setting settings[] = {{"every frame", 0, 1}, {"gate 1/8", 8, 1}, {"stride 2", 0, 2},
+                                {"stride 4", 0, 4}, {"gate 1/8, stride 2", 8, 2}};
+    for (bool night : {false, true}) {
+        std::cout << "== motion gate and stride, " << benchConfig.frames << " synthetic frames " << traffic.width
+                  << "x" << traffic.height << (night ? ", night (traffic 20% of the time)" : ", day") << std::endl;
+        auto busy = [&](int n) { return !night || n % 300 < 60; };
+        double fullMs = 0.0;
+        for (const auto &setting : settings) {
+            TrackingParams params;
+            params.motionGateScale = setting.gate;
+            params.frameStride = setting.stride;
+            params.countLines.push_back({"middle", cv::Point(traffic.width / 2, 0),
+                                         cv::Point(traffic.width / 2, traffic.height), traffic.lanes});
+            std::unique_ptr<MotionDetector> detector = createMotionDetector(params);
+            TrackerState tracks;
+            std::vector<Blob> curFrameBlobs;
+            ContourBuffers contourBuffers;
+            cv::Mat frame;
+            double ms = 0.0;
+            long quiet = 0, tracked = 0, vehicles = 0, found = 0, boxes = 0, matching = 0;
+
+            for (int n = 0; n < benchConfig.frames; n++) {
+                bool skipped = n % setting.stride != 0;
+                if (!skipped) {
+                    busy(n) ? scene.render(n, frame) : scene.renderRoad(n, frame);
+                }
+                auto start = std::chrono::steady_clock::now();
+                if (skipped) {
+                    extrapolateTracks(tracks, params);
+                } else {
+                    if (!detector->apply(frame)) {
+                        continue;
+                    }
+                    curFrameBlobs.clear();
+                    if (detector->moved()) {
+                        extractBlobs(detector->mask(), frame.size(), curFrameBlobs, params, contourBuffers);
+                    } else {
+                        quiet++;
+                    }
+                    matchCurrentFrameBlobsToExistingBlobs(tracks, curFrameBlobs, params);
+                    tracked++;
+                }
+                ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                std::vector<cv::Rect> truth;
+                if (busy(n)) {
+                    for (const auto &vehicle : scene.vehiclesAt(n)) {
+                        if ((vehicle.box & frameRect) == vehicle.box) {
+                            truth.push_back(vehicle.box);
+                        }
+                    }
+                }
+                std::vector<bool> seen(truth.size(), false);
+                for (const auto &blob : tracks.blobs) {
+                    if (!blob.blnStillBeingTracked) {
+                        continue;
+                    }
+                    boxes++;
+                    bool matches = false;
+                    for (size_t i = 0; i < truth.size(); i++) {
+                        if (intersectionOverUnion(blob.currentBoundingRect, truth[i]) >= 0.5) {
+                            seen[i] = true;
+                            matches = true;
+                        }
+                    }
+                    matching += matches;
+                }
+                vehicles += truth.size();
+                found += std::count(seen.begin(), seen.end(), true);
+            }
+
+            long crossings = 0;
+            for (const auto &counter : tracks.lineCounts) {
+                for (size_t lane = 0; lane < counter.forward.size(); lane++) {
+                    crossings += counter.forward[lane] + counter.backward[lane];
+                }
+            }
+            double frames = std::max(tracks.frame, 1);
+            if (fullMs == 0.0) {
+                fullMs = ms;
+            }
+            double recall = vehicles > 0 ? (double)found / vehicles : 1.0;
+            double precision = boxes > 0 ? (double)matching / boxes : 1.0;
+            std::string name = setting.name + (night ? " night" : " day");
+            record(name, {{"ms_per_frame", ms / frames}, {"fps", ms > 0 ? 1000.0 * frames / ms : 0.0},
+                          {"speedup", ms > 0 ? fullMs / ms : 0.0}, {"tracked_frames", (double)tracked},
+                          {"quiet_frames", (double)quiet}, {"recall", recall}, {"precision", precision},
+                          {"tracks", (double)tracks.nextId}, {"crossings", (double)crossings}});
+            std::cout << name << ": " << ms / frames << " ms/frame (" << (ms > 0 ? fullMs / ms : 0.0) << "x), "
+                      << tracked << " frames tracked, " << quiet << " gated out, recall " << recall
+                      << ", precision " << precision << ", " << tracks.nextId << " tracks, " << crossings
+                      << " crossings" << std::endl;
+        }
+    }
+}
+
+
+//extractBlobs as it was: a convex hull and a Blob for every contour, then the thresholds
+static void legacyExtractBlobs(cv::Mat &imgThreshold, std::vector<Blob> &curFrameBlobs, const TrackingParams &params) {
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(imgThreshold, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>> convexHulls(contours.size());
+    for (unsigned int i = 0; i < contours.size(); i++) {
+        cv::convexHull(contours[i], convexHulls[i]);
+    }
+    for (auto &convexHull : convexHulls) {
+        Blob possibleBlob(convexHull);
+        if (possibleBlob.currentBoundingRect.area() > params.minBlobArea &&
+            possibleBlob.dblCurrentAspectRatio > params.minAspectRatio &&
+            possibleBlob.dblCurrentAspectRatio < params.maxAspectRatio &&
+            possibleBlob.currentBoundingRect.width > params.minBlobWidth &&
+            possibleBlob.currentBoundingRect.height > params.minBlobHeight &&
+            possibleBlob.dblCurrentDiagonalSize > params.minBlobDiagonal &&
+            (cv::contourArea(convexHull) / (double)possibleBlob.currentBoundingRect.area()) > params.minFillRatio) {
+            curFrameBlobs.push_back(possibleBlob);
+        }
+    }
+}
+
+
+//Contour filtering on the motion masks of synthetic traffic, as it is and with three times the noise (many small
+//contours): the old hull-first filter against the bounding-rect test with reused buffers, checking both
+//accept the same boxes
+static void benchFilter() {
+    TrafficParams noisy = benchConfig.traffic;
+    noisy.noise *= 3;
+    const std::pair<std::string, TrafficParams> scenes[] = {{"", benchConfig.traffic}, {" noise x3", noisy}};
+    const int maskCount = std::min(benchConfig.frames, 120);
+    TrackingParams params;
+
+    for (const auto &scene : scenes) {
+        SyntheticTraffic traffic(scene.second);
+        FrameDiffer differ(params);
+        std::vector<cv::Mat> masks;
+        cv::Mat frame;
+        for (int n = 0; (int)masks.size() < maskCount && n < benchConfig.frames * 4; n++) {
+            traffic.render(n, frame);
+            if (differ.apply(frame) && differ.moved()) {
+                masks.push_back(differ.mask().clone());
+            }
+        }
+        if (masks.empty()) {
+            continue;
+        }
+
+        //findContours overwrites its input, so each step works on a copy of the mask
+        cv::Mat scratch;
+        std::vector<Blob> blobs;
+        ContourBuffers buffers;
+        long contours = 0;
+        StageResult legacy = measure(masks, [&](const cv::Mat &mask) {
+            mask.copyTo(scratch);
+            blobs.clear();
+            legacyExtractBlobs(scratch, blobs, params);
+        });
+        StageResult filter = measure(masks, [&](const cv::Mat &mask) {
+            mask.copyTo(scratch);
+            blobs.clear();
+            extractBlobs(scratch, mask.size(), blobs, params, buffers);
+            contours += buffers.contours.size();
+        });
+
+        bool same = true;
+        std::vector<Blob> legacyBlobs;
+        for (const auto &mask : masks) {
+            mask.copyTo(scratch);
+            legacyBlobs.clear();
+            legacyExtractBlobs(scratch, legacyBlobs, params);
+            mask.copyTo(scratch);
+            blobs.clear();
+            extractBlobs(scratch, mask.size(), blobs, params, buffers);
+            same = same && blobs.size() == legacyBlobs.size() &&
+                   std::equal(blobs.begin(), blobs.end(), legacyBlobs.begin(), [](const Blob &a, const Blob &b) {
+                       return a.currentBoundingRect == b.currentBoundingRect;
+                   });
+        }
+
+        std::cout << "== contour filtering" << scene.first << ", " << masks.size() << " masks "
+                  << scene.second.width << "x" << scene.second.height << ", "
+                  << (double)contours / (2 * masks.size()) << " contours/mask" << std::endl;
+        printResult("hull first" + scene.first, legacy);
+        printResult("rect first" + scene.first, filter);
+        std::cout << (same ? "same" : "DIFFERENT") << " boxes accepted" << std::endl;
+    }
+}
+
+
+//The synthetic scene as a video file, to run VehicleCounter_V2 itself on it
+static void writeSyntheticVideo(const std::string &path) {
+    const TrafficParams &traffic = benchConfig.traffic;
+    SyntheticTraffic scene(traffic);
+    cv::VideoWriter writer(path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 25.0, cv::Size(traffic.width, traffic.height));
+    if (!writer.isOpened()) {
+        std::cout << "Cannot write " << path << std::endl;
+        return;
+    }
+    cv::Mat frame;
+    for (int n = 0; n < benchConfig.frames; n++) {
+        scene.render(n, frame);
+        writer.write(frame);
+    }
+    std::cout << path << ": " << benchConfig.frames << " frames, " << scene.vehiclesEntered(benchConfig.frames)
+              << " vehicles" << std::endl;
+}
+
+
+static std::string jsonString(const std::string &value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+
+static bool writeJsonReport(const std::string &path) {
+    std::ofstream file(path);
+    const TrafficParams &traffic = benchConfig.traffic;
+    file << "{\"scene\":{\"width\":" << traffic.width << ",\"height\":" << traffic.height << ",\"lanes\":"
+         << traffic.lanes << ",\"vehicles\":" << traffic.vehicles << ",\"speed\":" << traffic.speed
+         << ",\"noise\":" << traffic.noise << ",\"seed\":" << traffic.seed << ",\"frames\":" << benchConfig.frames
+         << "},\n\"results\":[";
+    for (size_t i = 0; i < benchRecords.size(); i++) {
+        const BenchRecord &result = benchRecords[i];
+        file << (i > 0 ? ",\n" : "\n") << "{\"benchmark\":" << jsonString(result.benchmark)
+             << ",\"name\":" << jsonString(result.name);
+        for (const auto &value : result.values) {
+            file << "," << jsonString(value.first) << ":" << (std::isfinite(value.second) ? value.second : 0.0);
+        }
+        file << "}";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+
+static void printBenchUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options] [benchmark...]" << std::endl
+              << "Benchmarks: differ fused region match log db pipeline detectors gating filter (default: all)" << std::endl
+              << std::endl
+              << "Synthetic traffic of the pipeline, detectors, gating and filter benchmarks:" << std::endl
+              << "  --size <WxH>          frame size (default 1920x1080)" << std::endl
+              << "  --lanes <n>           lanes (default 4)" << std::endl
+              << "  --vehicles <n>        vehicles on screen at once (default 8)" << std::endl
+              << "  --speed <px>          pixels per frame (default 12)" << std::endl
+              << "  --noise <n>           background noise amplitude (default 20)" << std::endl
+              << "  --seed <n>            scene seed (default 1)" << std::endl
+              << "  --frames <n>          frames (default 600)" << std::endl
+              << "  --write-video <path>  also write the scene as an MJPG video" << std::endl
+              << "  --json <path>         write every result as JSON" << std::endl;
+}
+
+
+int main(int argc, char **argv) {
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+            {"differ", benchFrameDiffer},
+            {"fused", benchFused},
+            {"region", benchRegion},
+            {"match", benchMatching},
+            {"log", benchLogFormats},
+            {"db", benchDatabase},
+            {"pipeline", benchPipeline},
+            {"detectors", benchDetectors},
+            {"gating", benchGating},
+            {"filter", benchFilter},
+    };
+
+    std::vector<std::string> names;
+    TrafficParams &traffic = benchConfig.traffic;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printBenchUsage(argv[0]);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            names.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 2;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--size") {
+                size_t x = value.find('x');
+                if (x == std::string::npos) {
+                    throw std::invalid_argument(value);
+                }
+                traffic.width = std::stoi(value.substr(0, x));
+                traffic.height = std::stoi(value.substr(x + 1));
+            } else if (arg == "--lanes") {
+                traffic.lanes = std::stoi(value);
+            } else if (arg == "--vehicles") {
+                traffic.vehicles = std::stoi(value);
+            } else if (arg == "--speed") {
+                traffic.speed = std::stod(value);
+            } else if (arg == "--noise") {
+                traffic.noise = std::stoi(value);
+            } else if (arg == "--seed") {
+                traffic.seed = std::stoull(value);
+            } else if (arg == "--frames") {
+                benchConfig.frames = std::stoi(value);
+            } else if (arg == "--write-video") {
+                benchConfig.videoPath = value;
+            } else if (arg == "--json") {
+                benchConfig.jsonPath = value;
+            } else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                printBenchUsage(argv[0]);
+                return 2;
+            }
+        } catch (const std::logic_error &) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return 2;
+        }
+    }
+
+    if (!benchConfig.videoPath.empty()) {
+        writeSyntheticVideo(benchConfig.videoPath);
+    }
+    for (const auto &benchmark : benchmarks) {
+        bool selected = names.empty() && benchConfig.videoPath.empty();
+        for (const auto &name : names) {
+            selected = selected || benchmark.first == name;
+        }
+        if (selected) {
+            currentBenchmark = benchmark.first;
+            benchmark.second();
+        }
+    }
+    if (!benchConfig.jsonPath.empty() && !writeJsonReport(benchConfig.jsonPath)) {
+        std::cerr << "Cannot write " << benchConfig.jsonPath << std::endl;
+        return 1;
+    }
+    return 0;
+}